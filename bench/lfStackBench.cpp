@@ -0,0 +1,113 @@
+/// @file Multi-threaded throughput of lock-free and elimination stacks against mutex-wrapped Stack_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "cStack.h"
+#include "lfStack.h"
+#include "elimStack.h"
+#include "argvProcessor.h"
+
+typedef struct {
+    std::mutex mutex = {};
+    Stack_t stk = {};
+} MutexStack_t;
+
+static void lfWorker(LfStack_t *stk, size_t ops);
+static void elimWorker(ElimStack_t *stk, size_t ops);
+static void mutexWorker(MutexStack_t *stk, size_t ops);
+template <typename Worker, typename StackType>
+static double measure(Worker worker, StackType *stk, size_t threads, size_t ops);
+
+// Every worker does ops push + pop pairs, so stack stays small and contention is maximal
+static void lfWorker(LfStack_t *stk, size_t ops) {
+    stkElem_t val = 0;
+    for (size_t i = 0; i < ops; i++) {
+        lfStackPush(stk, (stkElem_t) i);
+        lfStackPop(stk, &val);
+    }
+}
+
+static void elimWorker(ElimStack_t *stk, size_t ops) {
+    stkElem_t val = 0;
+    for (size_t i = 0; i < ops; i++) {
+        elimStackPush(stk, (stkElem_t) i);
+        elimStackPop(stk, &val);
+    }
+}
+
+static void mutexWorker(MutexStack_t *stk, size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        {
+            std::lock_guard<std::mutex> lock(stk->mutex);
+            stackPush(&stk->stk, (stkElem_t) i);
+        }
+        {
+            std::lock_guard<std::mutex> lock(stk->mutex);
+            if (stackGetSize(&stk->stk))
+                stackPop(&stk->stk);
+        }
+    }
+}
+
+/// @return Millions of operations per second
+template <typename Worker, typename StackType>
+static double measure(Worker worker, StackType *stk, size_t threads, size_t ops) {
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < threads; i++)
+        pool.emplace_back(worker, stk, ops);
+    for (auto &thread : pool)
+        thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return 2.0 * (double) (threads * ops) / elapsed.count() / 1e6;
+}
+
+int main(int argc, const char *argv[]) {
+    logOpen();
+    setLogLevel(L_ZERO);
+
+    registerFlag(TYPE_INT, "-t", "--threads", "Maximum number of threads (default 32)");
+    registerFlag(TYPE_INT, "-n", "--ops", "Push+pop pairs per thread (default 200000)");
+    registerFlag(TYPE_INT, "-s", "--slots", "Elimination array size");
+    registerFlag(TYPE_INT, "-b", "--backoff", "Spins in elimination slot");
+    if (processArgs(argc, argv) != SUCCESS)
+        return 1;
+    size_t maxThreads = isFlagSet("-t") ? (size_t) getFlagValue("-t").int_ : 32;
+    size_t ops        = isFlagSet("-n") ? (size_t) getFlagValue("-n").int_ : 200000;
+    size_t slots      = isFlagSet("-s") ? (size_t) getFlagValue("-s").int_ : 0;
+    size_t backoff    = isFlagSet("-b") ? (size_t) getFlagValue("-b").int_ : 0;
+
+    printf("%8s %16s %16s %12s %16s\n", "threads", "lfStack Mops/s", "elim Mops/s", "eliminated", "mutex Mops/s");
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        LfStack_t lfStk = {};
+        lfStackCtor(&lfStk);
+        double lfRate = measure(lfWorker, &lfStk, threads, ops);
+        lfStackDtor(&lfStk);
+
+        ElimStack_t elimStk = {};
+        elimStackCtor(&elimStk, slots, backoff);
+        double elimRate = measure(elimWorker, &elimStk, threads, ops);
+        ElimStackStats_t stats = elimStackGetStats(&elimStk);
+        elimStackDtor(&elimStk);
+        double eliminated = 100.0 * (double) (stats.eliminatedPushes + stats.eliminatedPops) / (double) (2 * threads * ops);
+
+        MutexStack_t *mutexStk = new MutexStack_t();
+        stackCtor(&mutexStk->stk, 0);
+        double mutexRate = measure(mutexWorker, mutexStk, threads, ops);
+        stackDtor(&mutexStk->stk);
+        delete mutexStk;
+
+        printf("%8zu %16.2f %16.2f %11.1f%% %16.2f\n", threads, lfRate, elimRate, eliminated, mutexRate);
+    }
+
+    logClose();
+    return 0;
+}
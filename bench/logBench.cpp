@@ -0,0 +1,73 @@
+/// @file Cost of logPrintWithTime on caller's thread in synchronous and asynchronous modes
+// Measured messages are L_EXTRA, they must not be removed in release build
+#define LOG_COMPILED_LEVEL L_EXTRA
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "argvProcessor.h"
+
+static void logWorker(size_t ops);
+static double measure(size_t threads, size_t ops);
+
+// The same line as stackPush prints at L_EXTRA
+static void logWorker(size_t ops) {
+    for (size_t i = 0; i < ops; i++)
+        logPrintWithTime(L_EXTRA, 0, "Stack_t[%p] push: %zu\n", (void *) &ops, i);
+}
+
+/// @return Nanoseconds per message on caller's side
+static double measure(size_t threads, size_t ops) {
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < threads; i++)
+        pool.emplace_back(logWorker, ops);
+    for (auto &thread : pool)
+        thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e9 / (double) (threads * ops);
+}
+
+int main(int argc, const char *argv[]) {
+    logOpen();
+    setLogLevel(L_EXTRA);
+
+    registerFlag(TYPE_INT, "-t", "--threads", "Maximum number of threads (default 8)");
+    registerFlag(TYPE_INT, "-n", "--ops", "Messages per thread (default 100000)");
+    registerFlag(TYPE_INT, "-r", "--ring", "Ring size of thread in bytes (default LOG_RING_DEFAULT_BYTES)");
+    registerFlag(TYPE_BLANK, "-b", "--binary", "Write binary log.bin instead of log.txt");
+    if (processArgs(argc, argv) != SUCCESS)
+        return 1;
+    if (isFlagSet("-b")) {
+        logClose();
+        logOpenBinary();
+    }
+    size_t maxThreads = isFlagSet("-t") ? (size_t) getFlagValue("-t").int_ : 8;
+    size_t ops        = isFlagSet("-n") ? (size_t) getFlagValue("-n").int_ : 100000;
+    size_t ringBytes  = isFlagSet("-r") ? (size_t) getFlagValue("-r").int_ : LOG_RING_DEFAULT_BYTES;
+
+    printf("%8s %14s %14s %14s\n", "threads", "sync ns/msg", "block ns/msg", "count ns/msg");
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        double syncRate = measure(threads, ops);
+
+        logStartAsync(LOG_OVERFLOW_BLOCK, ringBytes);
+        double blockRate = measure(threads, ops);
+        logStopAsync();
+
+        logStartAsync(LOG_OVERFLOW_COUNT, ringBytes);
+        double countRate = measure(threads, ops);
+        logStopAsync();
+
+        printf("%8zu %14.1f %14.1f %14.1f\n", threads, syncRate, blockRate, countRate);
+    }
+
+    logClose();
+    return 0;
+}
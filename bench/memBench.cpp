@@ -0,0 +1,138 @@
+/// @file Throughput of memValSet and swap for every SIMD level against previous scalar versions,
+/// and of memHash backends
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "utils.h"
+#include "argvProcessor.h"
+
+static void legacyMemValSet(void *start, const void *elem, size_t elemSize, size_t length);
+static void legacySwap(void* a, void* b, size_t len);
+template <typename Func>
+static double measure(Func func, size_t bytes, size_t reps);
+
+/// memValSet before SIMD kernels: one memcpy per element
+static void legacyMemValSet(void *start, const void *elem, size_t elemSize, size_t length) {
+    char *ptr = (char*) start;
+    const char *elemPtr = (const char*) elem;
+    while (length--) {
+        memcpy(ptr, elemPtr, elemSize);
+        ptr += elemSize;
+    }
+}
+
+/// swap before SIMD kernels: 8-byte words
+static void legacySwap(void* a, void* b, size_t len) {
+    const unsigned blockSize = sizeof(uint64_t);
+    if (((size_t) a) % blockSize != ((size_t) b) % blockSize) {
+        swapByByte(a, b, len);
+        return;
+    }
+    const unsigned startOffset = (blockSize - ((size_t) a % blockSize)) % blockSize;
+    swapByByte(a, b, startOffset);
+    size_t llSteps = (len-startOffset) / blockSize;
+    uint64_t *lla = (uint64_t*) ((size_t)a + startOffset), *llb = (uint64_t*) ((size_t)b + startOffset);
+    while (llSteps--) {
+        uint64_t temp = *lla;
+        *lla++ = *llb;
+        *llb++ = temp;
+    }
+    swapByByte(lla, llb, (len-startOffset) % blockSize);
+}
+
+/// @return GB/s of bytes written
+template <typename Func>
+static double measure(Func func, size_t bytes, size_t reps) {
+    func(); // warm up caches and page tables
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reps; i++)
+        func();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double) (bytes * reps) / elapsed.count() / 1e9;
+}
+
+int main(int argc, const char *argv[]) {
+    logOpen();
+    setLogLevel(L_ZERO);
+
+    registerFlag(TYPE_INT, "-s", "--size", "Buffer size in bytes (default 1 MiB)");
+    registerFlag(TYPE_INT, "-n", "--reps", "Repetitions (default 200)");
+    if (processArgs(argc, argv) != SUCCESS)
+        return 1;
+    size_t bytes = isFlagSet("-s") ? (size_t) getFlagValue("-s").int_ : (1 << 20);
+    size_t reps  = isFlagSet("-n") ? (size_t) getFlagValue("-n").int_ : 200;
+
+    char *a = (char *) calloc(bytes, 1);
+    char *b = (char *) calloc(bytes, 1);
+    char *check = (char *) calloc(bytes, 1);
+    MY_ASSERT(a && b && check, abort());
+
+    const char *levelNames[] = {"scalar", "sse2", "avx2"};
+    enum SimdLevel supported = getSimdLevel();
+    const uint64_t elem[3] = {0xABADF00DA2DDEAD3, 0x1DED0BEDBAD0C0DE, 0x0F83E0F83E0F83E1};
+    const size_t elemSizes[] = {1, 4, 8, 24};
+
+    printf("%-8s %6s %14s", "op", "elem", "legacy GB/s");
+    for (int level = SIMD_SCALAR; level <= supported; level++)
+        printf(" %14s", levelNames[level]);
+    printf("\n");
+
+    for (size_t e = 0; e < ARRAY_SIZE(elemSizes); e++) {
+        size_t elemSize = elemSizes[e];
+        size_t length = bytes / elemSize;
+        printf("%-8s %6zu", "memValSet", elemSize);
+        printf(" %14.2f", measure([&]() { legacyMemValSet(a, elem, elemSize, length); }, length * elemSize, reps));
+        legacyMemValSet(check, elem, elemSize, length);
+        for (int level = SIMD_SCALAR; level <= supported; level++) {
+            setSimdLevel((enum SimdLevel) level);
+            memset(a, 0, bytes);
+            double rate = measure([&]() { memValSet(a, elem, elemSize, length); }, length * elemSize, reps);
+            MY_ASSERT(memcmp(a, check, length * elemSize) == 0, abort());
+            printf(" %14.2f", rate);
+        }
+        printf("\n");
+    }
+
+    // Odd offset: legacy swap falls back to byte loop when a and b are misaligned differently
+    for (size_t offset = 0; offset < 2; offset++) {
+        size_t len = bytes - offset;
+        printf("%-8s %5s%zu", "swap", "+", offset);
+        printf(" %14.2f", measure([&]() { legacySwap(a, b + offset, len); }, 2 * len, reps));
+        for (int level = SIMD_SCALAR; level <= supported; level++) {
+            setSimdLevel((enum SimdLevel) level);
+            memset(a, 'a', bytes);
+            memset(b, 'b', bytes);
+            swap(a, b + offset, len);
+            MY_ASSERT(a[0] == 'b' && a[len-1] == 'b' && b[offset] == 'a' && b[bytes-1] == 'a', abort());
+            double rate = measure([&]() { swap(a, b + offset, len); }, 2 * len, reps);
+            printf(" %14.2f", rate);
+        }
+        printf("\n");
+    }
+    setSimdLevel(supported);
+
+    const char *backendNames[] = {"djb2", "xxh64", "crc32c"};
+    enum MemHashBackend defaultBackend = getMemHashBackend();
+    printf("\n%-8s %14s %14s\n", "hash", "GB/s", "chunked GB/s");
+    for (int backend = MEM_HASH_DJB2; backend <= MEM_HASH_CRC32C; backend++) {
+        setMemHashBackend((enum MemHashBackend) backend);
+        volatile uint64_t sink = 0;
+        double rate = measure([&]() { sink = sink + memHash(a, bytes); }, bytes, reps);
+        // What stack verification does: full chunks with backend, tail with djb2
+        double chunkedRate = measure([&]() { sink = sink + memChunkHashCompute(a, bytes).chunks; }, bytes, reps);
+        printf("%-8s %14.2f %14.2f\n", backendNames[backend], rate, chunkedRate);
+    }
+    setMemHashBackend(defaultBackend);
+
+    free(a);
+    free(b);
+    free(check);
+    logClose();
+    return 0;
+}
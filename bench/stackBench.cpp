@@ -0,0 +1,268 @@
+/// @file ns/op of Stack_t operations at several sizes against std::vector and std::stack,
+/// results are printed as table and optionally written as CSV and JSON
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <vector>
+#include <stack>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "cStack.h"
+#include "argvProcessor.h"
+
+/// @brief One measured operation
+typedef struct {
+    const char *container;
+    const char *op;
+    size_t size;                        ///< Elements in every stack
+    size_t ops;                         ///< Operations measured
+    double seconds;                     ///< Time of all operations
+} BenchResult_t;
+
+/// Small stacks are measured in batches of many stacks, so clock isn't read every few operations
+static const size_t BATCH_ELEMS = 4096;
+static const size_t SIZES[] = {16, 1024, 65536, 1 << 20};
+
+/// Value is treated as used and memory as changed, so loop of reads isn't folded by compiler
+static inline void keep(stkElem_t val) {
+    asm volatile("" : : "r"(val) : "memory");
+}
+
+/// Stack_t with reserved capacity, shrinking only when asked
+struct CStackOps {
+    typedef Stack_t Type;
+    static constexpr const char *NAME = "Stack_t";
+    static void ctor(Stack_t *stk, size_t capacity, bool shrink) {
+        stackCtor(stk, 0);
+        if (!shrink)
+            stackSetCapacityPolicy(stk, &STACK_NEVER_SHRINK_POLICY);
+        stackReserve(stk, capacity);
+    }
+    static void dtor(Stack_t *stk)                  { stackDtor(stk); }
+    static void push(Stack_t *stk, stkElem_t val)   { stackPush(stk, val); }
+    static stkElem_t pop(Stack_t *stk)              { return stackPop(stk); }
+    static stkElem_t top(Stack_t *stk)              { return stackTop(stk); }
+    static size_t size(Stack_t *stk)                { return stackGetSize(stk); }
+};
+
+struct VectorOps {
+    typedef std::vector<stkElem_t> Type;
+    static constexpr const char *NAME = "std::vector";
+    static void ctor(Type *vec, size_t capacity, bool) { vec->reserve(capacity); }
+    static void dtor(Type *vec)                     { Type().swap(*vec); }
+    static void push(Type *vec, stkElem_t val)      { vec->push_back(val); }
+    static stkElem_t pop(Type *vec)                 { stkElem_t val = vec->back(); vec->pop_back(); return val; }
+    static stkElem_t top(Type *vec)                 { return vec->back(); }
+    static size_t size(Type *vec)                   { return vec->size(); }
+};
+
+struct StdStackOps {
+    typedef std::stack<stkElem_t> Type;
+    static constexpr const char *NAME = "std::stack";
+    static void ctor(Type *, size_t, bool)          {}
+    static void dtor(Type *stk)                     { Type().swap(*stk); }
+    static void push(Type *stk, stkElem_t val)      { stk->push(val); }
+    static stkElem_t pop(Type *stk)                 { stkElem_t val = stk->top(); stk->pop(); return val; }
+    static stkElem_t top(Type *stk)                 { return stk->top(); }
+    static size_t size(Type *stk)                   { return stk->size(); }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start);
+static const char *getConfigName();
+template <typename Ops>
+static void benchContainer(std::vector<BenchResult_t> *results, size_t size, size_t budget);
+static void benchVerify(std::vector<BenchResult_t> *results, size_t size, size_t budget);
+static void printTable(const char *config, const std::vector<BenchResult_t> &results);
+static bool writeCsv(const char *path, const char *config, const std::vector<BenchResult_t> &results);
+static bool writeJson(const char *path, const char *config, const std::vector<BenchResult_t> &results);
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/// Build configuration is part of results, so runs of different builds can be put in one file
+static const char *getConfigName() {
+#ifdef STACK_GUARD_PAGES
+    return "guard";
+#endif
+    bool canary = false, hash = false;
+    ON_CANARY(canary = true;)
+    ON_HASH(hash = true;)
+#ifndef NDEBUG
+    return (canary && hash) ? "debug" : (canary) ? "debug-canary" : (hash) ? "debug-hash" : "debug-none";
+#else
+    return (canary && hash) ? "release-protected" : (canary) ? "release-canary" : (hash) ? "release-hash" : "release";
+#endif
+}
+
+/// push, top and pop on full stacks, mixed operations around half size, grow/shrink from empty stack
+template <typename Ops>
+static void benchContainer(std::vector<BenchResult_t> *results, size_t size, size_t budget) {
+    size_t batch  = (size < BATCH_ELEMS) ? BATCH_ELEMS / size : 1;
+    size_t rounds = (budget > batch * size) ? budget / (batch * size) : 1;
+    size_t ops = rounds * batch * size;
+    std::vector<typename Ops::Type> stacks(batch);
+    double pushTime = 0, topTime = 0, popTime = 0, mixedTime = 0, cycleTime = 0;
+
+    for (auto &stk : stacks)
+        Ops::ctor(&stk, size, false);
+    for (size_t round = 0; round < rounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto &stk : stacks)
+            for (size_t i = 0; i < size; i++)
+                Ops::push(&stk, (stkElem_t) i);
+        pushTime += secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (auto &stk : stacks)
+            for (size_t i = 0; i < size; i++)
+                keep(Ops::top(&stk));
+        topTime += secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (auto &stk : stacks)
+            for (size_t i = 0; i < size; i++)
+                keep(Ops::pop(&stk));
+        popTime += secondsSince(start);
+    }
+
+    // 3 pushes for 2 pops in pseudo-random order
+    uint32_t seed = 12345;
+    for (auto &stk : stacks)
+        for (size_t i = 0; i < size / 2; i++)
+            Ops::push(&stk, (stkElem_t) i);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++)
+        for (auto &stk : stacks)
+            for (size_t i = 0; i < size; i++) {
+                seed = seed * 1103515245 + 12345;
+                if ((seed >> 16) % 5 < 3 || Ops::size(&stk) == 0)
+                    Ops::push(&stk, (stkElem_t) i);
+                else
+                    keep(Ops::pop(&stk));
+            }
+    mixedTime = secondsSince(start);
+    for (auto &stk : stacks)
+        Ops::dtor(&stk);
+
+    // Whole life of stack: construction, growth from nothing, shrinking and destruction
+    start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++)
+        for (auto &stk : stacks) {
+            Ops::ctor(&stk, 0, true);
+            for (size_t i = 0; i < size; i++)
+                Ops::push(&stk, (stkElem_t) i);
+            for (size_t i = 0; i < size; i++)
+                keep(Ops::pop(&stk));
+            Ops::dtor(&stk);
+        }
+    cycleTime = secondsSince(start);
+
+    results->push_back({Ops::NAME, "push",       size, ops,     pushTime});
+    results->push_back({Ops::NAME, "top",        size, ops,     topTime});
+    results->push_back({Ops::NAME, "pop",        size, ops,     popTime});
+    results->push_back({Ops::NAME, "mixed",      size, ops,     mixedTime});
+    results->push_back({Ops::NAME, "growShrink", size, 2 * ops, cycleTime});
+}
+
+/// One op is stackVerify of whole stack
+static void benchVerify(std::vector<BenchResult_t> *results, size_t size, size_t budget) {
+    size_t calls = (budget > size) ? budget / size : 1;
+    Stack_t stk = {};
+    CStackOps::ctor(&stk, size, false);
+    for (size_t i = 0; i < size; i++)
+        stackPush(&stk, (stkElem_t) i);
+
+    StackError_t err = STACK_OK;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++)
+        err |= stackVerify(&stk);
+    double seconds = secondsSince(start);
+    MY_ASSERT(err == STACK_OK, abort());
+    stackDtor(&stk);
+    results->push_back({CStackOps::NAME, "verify", size, calls, seconds});
+}
+
+static void printTable(const char *config, const std::vector<BenchResult_t> &results) {
+    printf("config: %s\n", config);
+    printf("%-12s %-11s %9s %12s %10s %14s\n", "container", "op", "size", "ops", "ns/op", "ops/sec");
+    for (const BenchResult_t &res : results)
+        printf("%-12s %-11s %9zu %12zu %10.2f %14.0f\n", res.container, res.op, res.size, res.ops,
+               res.seconds * 1e9 / (double) res.ops, (double) res.ops / res.seconds);
+}
+
+/// Rows are appended, header is written to empty file
+static bool writeCsv(const char *path, const char *config, const std::vector<BenchResult_t> &results) {
+    FILE *file = fopen(path, "a");
+    if (!file)
+        return false;
+    if (ftell(file) == 0)
+        fprintf(file, "config,container,op,size,ops,ns_per_op,ops_per_sec\n");
+    for (const BenchResult_t &res : results)
+        fprintf(file, "%s,%s,%s,%zu,%zu,%.3f,%.0f\n", config, res.container, res.op, res.size, res.ops,
+                res.seconds * 1e9 / (double) res.ops, (double) res.ops / res.seconds);
+    fclose(file);
+    return true;
+}
+
+static bool writeJson(const char *path, const char *config, const std::vector<BenchResult_t> &results) {
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\n  \"config\": \"%s\",\n  \"results\": [\n", config);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult_t &res = results[i];
+        fprintf(file, "    {\"container\": \"%s\", \"op\": \"%s\", \"size\": %zu, \"ops\": %zu, "
+                      "\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f}%s\n",
+                res.container, res.op, res.size, res.ops, res.seconds * 1e9 / (double) res.ops,
+                (double) res.ops / res.seconds, (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    logOpen();
+    setLogLevel(L_ZERO);
+
+    registerFlag(TYPE_INT, "-n", "--max-size", "Largest stack size (default 1M, 1024 in debug build)");
+    registerFlag(TYPE_INT, "-o", "--ops", "Operations per measurement (default 4M, 32K in debug build)");
+    registerFlag(TYPE_INT, "-v", "--verify", "StackVerifyLevel for all stacks (default is level of build)");
+    registerFlag(TYPE_STRING, "-c", "--csv", "Append results to CSV file");
+    registerFlag(TYPE_STRING, "-j", "--json", "Write results to JSON file");
+    registerFlag(TYPE_STRING, "-l", "--label", "Config name in results (default is derived from build)");
+    if (processArgs(argc, argv) != SUCCESS)
+        return 1;
+#ifndef NDEBUG
+    size_t maxSize = 1024, budget = 1 << 15;
+#else
+    size_t maxSize = 1 << 20, budget = 1 << 22;
+#endif
+    if (isFlagSet("-n")) maxSize = (size_t) getFlagValue("-n").int_;
+    if (isFlagSet("-o")) budget  = (size_t) getFlagValue("-o").int_;
+    if (isFlagSet("-v")) stackSetGlobalVerifyLevel((enum StackVerifyLevel) getFlagValue("-v").int_, 0);
+    const char *config = isFlagSet("-l") ? getFlagValue("-l").string_ : getConfigName();
+
+    std::vector<BenchResult_t> results;
+    for (size_t size : SIZES) {
+        if (size > maxSize)
+            break;
+        benchContainer<CStackOps>(&results, size, budget);
+        benchContainer<VectorOps>(&results, size, budget);
+        benchContainer<StdStackOps>(&results, size, budget);
+        benchVerify(&results, size, budget);
+    }
+
+    printTable(config, results);
+    if (isFlagSet("-c") && !writeCsv(getFlagValue("-c").string_, config, results))
+        fprintf(stderr, "Can't write %s\n", getFlagValue("-c").string_);
+    if (isFlagSet("-j") && !writeJson(getFlagValue("-j").string_, config, results))
+        fprintf(stderr, "Can't write %s\n", getFlagValue("-j").string_);
+    logClose();
+    return 0;
+}
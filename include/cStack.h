@@ -5,12 +5,19 @@
 #ifndef C_STACK_H
 #define C_STACK_H
 
-#define CANARY_PROTECTION
-#define HASH_PROTECTION
+// Define STACK_NO_CANARY or STACK_NO_HASH to build without one of protections
+#ifndef STACK_NO_CANARY
+# define CANARY_PROTECTION
+#endif
+#ifndef STACK_NO_HASH
+# define HASH_PROTECTION
+#endif
 
 /*------------------DEFINES FOR CONDITIONAL COMPILATION-----------------------*/
 
-#ifndef NDEBUG
+// Define STACK_RELEASE_PROTECTION to keep canaries and hashes with NDEBUG,
+// so release binaries can run cheap checks (see StackVerifyLevel)
+#if !defined(NDEBUG) || defined(STACK_RELEASE_PROTECTION)
 
 # ifdef CANARY_PROTECTION
 #  define ON_CANARY(...) __VA_ARGS__
@@ -24,27 +31,55 @@
 #  define ON_HASH(...)
 # endif
 
-# define ON_DEBUG(...) __VA_ARGS__
-
 #else
 
-# define ON_DEBUG(...)
 # define ON_CANARY(...)
 # define ON_HASH(...)
 
 #endif
 
+// Stacks with capacity up to STACK_INLINE_CAPACITY keep elements inside Stack_t
+// instead of allocated block; define it as 0 to disable small-buffer optimization
+#ifndef STACK_INLINE_CAPACITY
+# define STACK_INLINE_CAPACITY 16
+#endif
+
+#ifndef NDEBUG
+# define ON_DEBUG(...) __VA_ARGS__
+#else
+# define ON_DEBUG(...)
+#endif
+
+// Per-stack counters and timers (see stackGetStats) are kept in debug build,
+// define STACK_METRICS to keep them with NDEBUG or STACK_NO_METRICS to drop them
+#if !defined(NDEBUG) && !defined(STACK_NO_METRICS) && !defined(STACK_METRICS)
+# define STACK_METRICS
+#endif
+
+#ifdef STACK_METRICS
+# define ON_METRICS(...) __VA_ARGS__
+#else
+# define ON_METRICS(...)
+#endif
+
 /*------------------STRUCTS AND CONSTANTS-------------------------------------*/
 
+#include "utils.h"
+#include "stackAlloc.h"
+
 typedef int stkElem_t;
 const stkElem_t POISON_ELEM = stkElem_t(0xABADF00DA2DDEAD3);        //this value is filled in empty memory
 #define STK_ELEM_FMT "%d"
+const size_t MAX_STACK_SIZE = 1 << 28;                             ///< Stack never holds this many elements
 ON_CANARY(                                              \
 static const uint64_t XOR_CONST =  0xEDABEDAF8A40FF15;  \
 typedef uint64_t canary_t;                              \
 )
 ON_HASH(typedef uint64_t hash_t;)
 
+/// Inline data block has the same layout as allocated one: [canary][elements][pad to 8][canary]
+const size_t STACK_INLINE_BLOCK_WORDS = (STACK_INLINE_CAPACITY * sizeof(stkElem_t) + 7) / 8 ON_CANARY(+ 2);
+
 typedef uint64_t StackError_t;
 enum StackErrors {
     STACK_OK                = 0,                    ///< Ok
@@ -54,21 +89,101 @@ enum StackErrors {
     ERR_CAPACITY            = 1 << 3,               ///< Capacity > maxSize
     ERR_LOGIC               = 1 << 4,               ///< Size > capacity
 
-    ON_CANARY(
+    // Defined even without protection, so all stack flavours share error codes
     ERR_CANARY_LEFT         = 1 << 5,               ///< Wrong left stack canary
     ERR_CANARY_RIGHT        = 1 << 6,               ///< Wrong right stack canary
     ERR_DATA_CANARY_LEFT    = 1 << 7,               ///< Wrong left data canary
     ERR_DATA_CANARY_RIGHT   = 1 << 8,               ///< Wrong right data canary
     ERR_CANARY              = ((1 << 4) - 1) << 5,  ///< Any canary is wrong
-    )
 
-    ON_HASH(
     ERR_HASH_DATA           = 1 << 9,               ///< Incorrect data hash
     ERR_HASH_STACK          = 1 << 10,              ///< Incorrect stack hash
-    )
+
+    ERR_EMPTY               = 1 << 11,              ///< Stack is empty (returned by concurrent stacks)
+    ERR_FILE                = 1 << 12,              ///< Stack file can't be mapped or has wrong header
 };
 
+/// @brief How much checking is done by STACK_ASSERT on every operation
+enum StackVerifyLevel {
+    VERIFY_DEFAULT = 0,     ///< Use global level (per-stack setting only)
+    VERIFY_OFF,             ///< No checks
+    VERIFY_CANARY,          ///< O(1) checks: sizes, pointers and canaries
+    VERIFY_SAMPLED,         ///< Full check after every samplePeriod changes of stack, canaries otherwise
+    VERIFY_FULL             ///< Full stackVerify on every operation
+};
+
+/// @brief How unused part of data [size, capacity) is kept
+enum StackPoisonMode {
+    POISON_EAGER = 0,       ///< Filled with POISON_ELEM on every grow
+    POISON_LAZY,            ///< Only slots below high-water mark hold POISON_ELEM, grow writes nothing
+    POISON_ASAN             ///< Marked unaddressable for AddressSanitizer, POISON_LAZY in builds without it
+};
+
+/// @brief When and how stack changes its capacity
+typedef struct {
+    double growFactor;                          ///< capacity is multiplied by it when stack is full
+    size_t shrinkRatio;                         ///< underused: shrinkRatio * size < capacity; 0 = never shrink
+    size_t minCapacity;                         ///< no shrinking below it, first allocation is at least it
+    size_t shrinkDelay;                         ///< shrink only after more than shrinkDelay underused operations in a row
+} StackCapacityPolicy_t;
+
+/// @brief Double when full, halve when less than quarter is used
+extern const StackCapacityPolicy_t STACK_DEFAULT_POLICY;
+/// @brief Double when full, never shrink (use stackShrinkToFit)
+extern const StackCapacityPolicy_t STACK_NEVER_SHRINK_POLICY;
+
+/// @brief What stackDump prints of elements
 typedef struct {
+    size_t bottomElems;                         ///< Elements printed from bottom of every region
+    size_t topElems;                            ///< Elements printed from top of every region, the rest are skipped
+    bool collapseRuns;                          ///< Equal neighbours are printed as one line with count
+    const char *rawPath;                        ///< File for raw bytes of all elements, NULL to skip it
+} StackDumpOptions_t;
+
+/// @brief 16 elements from bottom and 64 from top, runs collapsed, no raw file
+extern const StackDumpOptions_t STACK_DUMP_DEFAULT_OPTIONS;
+/// @brief Every element on its own line, as dumps of small stacks used to be
+extern const StackDumpOptions_t STACK_DUMP_FULL_OPTIONS;
+
+/*!
+    @brief What stack did since construction (STACK_METRICS builds)
+
+    Hash time includes hashes computed by stackVerify, so hashNs is part of verifyNs for them.
+*/
+typedef struct {
+    size_t pushes;                              ///< Elements pushed
+    size_t pops;                                ///< Elements popped
+    size_t grows;                               ///< Reallocations to bigger capacity
+    size_t shrinks;                             ///< Reallocations to smaller capacity
+    size_t bytesCopied;                         ///< Element bytes moved to new block by reallocations
+    size_t peakSize;                            ///< Largest size
+    size_t verifyCalls;                         ///< Calls of stackVerify
+    uint64_t verifyNs;                          ///< Time in stackVerify
+    size_t hashCalls;                           ///< Data and stack hash computations and updates
+    uint64_t hashNs;                            ///< Time in hash functions
+} StackStats_t;
+
+const uint64_t STACK_FILE_MAGIC = 0x3150414D4B545343;  ///< "CSTKMAP1"
+
+/*!
+    @brief Header of file with mapped stack, written after every operation
+
+    Header canaries and hash don't depend on address, data canaries are checked
+    against blockAddress on open and then refilled for new mapping.
+*/
+typedef struct {
+    uint64_t magic;                             ///< STACK_FILE_MAGIC
+    uint64_t goose1;                            ///< STACK_FILE_MAGIC ^ XOR of canaries
+    uint64_t layout;                            ///< Element size, protections and hash backend of writer
+    uint64_t size;                              ///< Number of elements
+    uint64_t capacity;                          ///< Capacity of data block
+    uint64_t blockAddress;                      ///< Data block address used in its canaries
+    memChunkHash_t dataHash;                    ///< Hash of elements in [0, size)
+    uint64_t headerHash;                        ///< Hash of header with headerHash = 0
+    uint64_t goose2;                            ///< second canary
+} StackFileHeader_t;
+
+typedef struct CStack {
     ON_CANARY(canary_t goose1;)                 ///< first canary
     ON_DEBUG(
     const char *initFile;                       ///< file where stack was constructed
@@ -78,21 +193,58 @@ typedef struct {
     size_t size;                                ///< Number of elements in stack
     size_t capacity;                            ///< Size of reserved memory
     stkElem_t *data;                            ///< Array with elements
+    const StackAllocator_t *allocator;          ///< Allocator of data block
+    StackFileMap_t *fileMap;                    ///< Mapped file with data, NULL for stacks in memory
+    StackCapacityPolicy_t policy;               ///< Grow and shrink rules
+    size_t underusedOps;                        ///< Underused operations in a row
+    enum StackPoisonMode poisonMode;            ///< How [size, capacity) is kept
+    size_t highWater;                           ///< Slots [highWater, capacity) were never written
+    size_t lowWater;                            ///< Elements [0, lowWater) weren't changed since last checkpoint
+    uint64_t checkpointTag;                     ///< Checksum of last snapshot saved or loaded, 0 if none
+    enum StackVerifyLevel verifyLevel;          ///< Checks done on every operation
+    size_t samplePeriod;                        ///< Full check period for VERIFY_SAMPLED
+    size_t opCounter;                           ///< Changes of stack, for VERIFY_SAMPLED (not hashed)
     ON_HASH(
-    hash_t dataHash;                            ///< Hash of elements (of all allocated memory)
+    memChunkHash_t dataHash;                    ///< Hash of elements in [0, size), updated per push/pop
     hash_t stackHash;                           ///< Hash of struct itself
     )
+    // Fields below are not in stackHash: they are changed by checks, registry and scrubber
+    size_t writeSeq;                            ///< Odd while stack is being changed, read by scrubber
+    struct CStack *registryPrev;                ///< Previous stack in registry of live stacks
+    struct CStack *registryNext;                ///< Next stack in registry of live stacks
+    bool scrubReported;                         ///< Scrubber has already reported error of this stack
+    ON_METRICS(StackStats_t stats;)             ///< Counters and timers
+#if STACK_INLINE_CAPACITY > 0
+    uint64_t inlineBlock[STACK_INLINE_BLOCK_WORDS]; ///< Data block while capacity fits in it (covered by dataHash)
+#endif
     ON_CANARY(canary_t goose2;)                 ///< Second canary
 } Stack_t;
 
 /* -----------------FUNCTIONS TO WORK WITH STACK------------------------------*/
 
 /// @brief Construct stack with given capacity
-#define stackCtor(stk, startCapacity) stackCtorBase(stk, startCapacity ON_DEBUG(, __FILE__, __LINE__, #stk))
+/// Up to STACK_INLINE_CAPACITY elements are stored in Stack_t itself without allocation
+#define stackCtor(stk, startCapacity) stackCtorBase(stk, startCapacity, NULL ON_DEBUG(, __FILE__, __LINE__, #stk))
+
+/// @brief Construct stack with given capacity, data is allocated by allocator
+#define stackCtorAlloc(stk, startCapacity, allocator) \
+    stackCtorBase(stk, startCapacity, allocator ON_DEBUG(, __FILE__, __LINE__, #stk))
+
+/// @brief Open stack stored in file, or create empty one if file doesn't exist
+/// Data stays in mapped file, header with size and hashes is updated by every operation
+/// @return ERR_FILE if file can't be mapped, other errors if its header or data is broken
+#define stackCtorMapped(stk, path) stackCtorMappedBase(stk, path ON_DEBUG(, __FILE__, __LINE__, #stk))
 
 /// @brief Delete stack
+/// Mapped stack is emptied and its file is truncated to header, use stackCloseMapped to keep it
 StackError_t stackDtor(Stack_t *stk);
 
+/// @brief Unmap stack opened by stackCtorMapped, file keeps its contents
+StackError_t stackCloseMapped(Stack_t *stk);
+
+/// @brief Flush mapped stack to disk with msync
+StackError_t stackSyncMapped(Stack_t *stk);
+
 /// @brief Push element to stack
 #define stackPush(stk, val) stackPushBase(stk, val ON_DEBUG(, __FILE__, __LINE__, #stk))
 
@@ -100,25 +252,144 @@ StackError_t stackDtor(Stack_t *stk);
 /// You can't use this function when size is 0
 #define stackPop(stk) stackPopBase(stk ON_DEBUG(, __FILE__, __LINE__, #stk))
 
+/// @brief Push n elements from src array to stack
+/// Grows buffer, verifies and rehashes once per call
+#define stackPushN(stk, src, n) stackPushNBase(stk, src, n ON_DEBUG(, __FILE__, __LINE__, #stk))
+
+/// @brief Pop n elements from stack to out array (can be NULL)
+/// out gets elements in push order: out[n-1] is the former top
+#define stackPopN(stk, out, n) stackPopNBase(stk, out, n ON_DEBUG(, __FILE__, __LINE__, #stk))
+
+/// @brief Make sure stack can hold capacity elements without reallocation
+StackError_t stackReserve(Stack_t *stk, size_t capacity);
+
+/// @brief Set grow and shrink rules of stack
+StackError_t stackSetCapacityPolicy(Stack_t *stk, const StackCapacityPolicy_t *policy);
+
+/// @brief Reduce capacity to size
+StackError_t stackShrinkToFit(Stack_t *stk);
+
 /// @brief Get top element from stack
 stkElem_t stackTop(Stack_t *stk);
 
 /// @brief Get stack size
 size_t stackGetSize(Stack_t *stk);
 
+/// @brief Get counters and timers of stack, all zero in builds without STACK_METRICS
+StackStats_t stackGetStats(Stack_t *stk);
+
+/// @brief Zero counters and timers of stack, peak size becomes current size
+StackError_t stackResetStats(Stack_t *stk);
+
 /// @brief Check stk for errors
 /// Return false if there's any error, wright it in err field of stack
 StackError_t stackVerify(Stack_t *stk);
 
+/// @brief Check stk according to its verify level (or global one)
+/// Used by STACK_ASSERT, cheaper than stackVerify unless level is VERIFY_FULL
+StackError_t stackCheck(Stack_t *stk);
+
+/// @brief Set verify level for all stacks with VERIFY_DEFAULT level
+/// samplePeriod is used by VERIFY_SAMPLED, 0 keeps current period
+void stackSetGlobalVerifyLevel(enum StackVerifyLevel level, size_t samplePeriod);
+
+/// @brief Set verify level for given stack, VERIFY_DEFAULT to follow global level
+/// samplePeriod is used by VERIFY_SAMPLED, 0 means global period
+StackError_t stackSetVerifyLevel(Stack_t *stk, enum StackVerifyLevel level, size_t samplePeriod);
+
+/// @brief Set poison mode used by stackCtor
+/// Default is POISON_ASAN in AddressSanitizer builds and POISON_LAZY otherwise
+void stackSetDefaultPoisonMode(enum StackPoisonMode mode);
+
+/// @brief Change poison mode of existing stack
+StackError_t stackSetPoisonMode(Stack_t *stk, enum StackPoisonMode mode);
+
 /// @brief Wright stack dump is log file
-#define stackDump(stk) stackDumpBase(stk, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+/// Elements are printed according to options set by stackSetDumpOptions
+#define stackDump(stk) stackDumpBase(stk, NULL, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+/// @brief Wright stack dump is log file with given options
+#define stackDumpWithOptions(stk, options) stackDumpBase(stk, options, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+/// @brief Set options used by stackDump (STACK_DUMP_DEFAULT_OPTIONS by default)
+void stackSetDumpOptions(const StackDumpOptions_t *options);
 
 /// @brief Convert stack error code to string
 const char *stackFirstErrorToStr(StackError_t err);
 
+/* -----------------REGISTRY AND SCRUBBER-------------------------------------*/
+// Every constructed stack is in registry until stackDtor or stackCloseMapped,
+// so stacks must not be freed or go out of scope before them
+
+/// @brief Called by scrubber thread after dump of the first error found in stack
+typedef void (*StackScrubCallback_t)(Stack_t *stk, StackError_t err, void *ctx);
+
+/// @brief What scrubber did since start
+typedef struct {
+    size_t passes;                              ///< Passes over whole registry
+    size_t checked;                             ///< Stacks verified
+    size_t busy;                                ///< Stacks skipped because writer changed them during every try
+    size_t errors;                              ///< Stacks reported
+} StackScrubStats_t;
+
+/// @brief Memory held by stacks, as requested from their allocators
+typedef struct {
+    size_t stacks;                              ///< Stacks counted
+    size_t usedBytes;                           ///< Elements in [0, size)
+    size_t capacityBytes;                       ///< Elements in [0, capacity)
+    size_t blockBytes;                          ///< Allocated data blocks with canaries and padding, 0 for inline data
+    size_t structBytes;                         ///< Stack_t structs, inline data included
+} StackMemory_t;
+
+const size_t STACK_DUMP_ALL_LINES = 32;        ///< Stacks listed by stackDumpAll, the rest are only counted
+
+/// @brief Number of live stacks
+size_t stackRegistryCount();
+
+/// @brief Memory of one stack
+StackMemory_t stackGetMemory(Stack_t *stk);
+
+/// @brief Memory of all live stacks
+StackMemory_t stackRegistryMemory();
+
+/*!
+    @brief Wright summary of all live stacks in log file
+
+    Totals of used and reserved memory are followed by one line per stack, stacks that
+    waste most memory first; stacks that would give back at least half of their block
+    with stackShrinkToFit are marked "trim".
+*/
+#define stackDumpAll() stackDumpAllBase(__FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+/*!
+    @brief Start thread that verifies registered stacks one by one
+
+    Full stackVerify runs in scrubber thread under seqlock of stack: result is dropped and
+    check is retried if owner changed stack meanwhile, so push and pop never wait for it.
+    Only reallocation (and poisoning in AddressSanitizer builds) of the stack being
+    checked waits until that check ends. Errors are dumped and passed to callback once
+    per stack. Stack checked by scrubber must not be used by threads other than its owner.
+
+    @param stacksPerSecond Scrub rate, 0 for no pause between stacks
+    @param callback        Can be NULL
+*/
+StackError_t stackScrubStart(size_t stacksPerSecond, StackScrubCallback_t callback, void *ctx);
+
+/// @brief Change scrub rate of running scrubber, 0 for no pause between stacks
+void stackScrubSetRate(size_t stacksPerSecond);
+
+/// @brief Stop and join scrubber thread
+void stackScrubStop();
+
+/// @brief Counters of scrubber since last stackScrubStart
+StackScrubStats_t stackScrubGetStats();
+
 /* -----------------BASE LIBRARY FUNCTIONS; DO NOT USE------------------------*/
 
-StackError_t stackCtorBase(Stack_t *stk, size_t startCapacity
+StackError_t stackCtorBase(Stack_t *stk, size_t startCapacity, const StackAllocator_t *allocator
+                ON_DEBUG(, const char *initFile, int initLine, const char *name));
+
+StackError_t stackCtorMappedBase(Stack_t *stk, const char *path
                 ON_DEBUG(, const char *initFile, int initLine, const char *name));
 
 StackError_t stackPushBase(Stack_t *stk, stkElem_t val
@@ -127,26 +398,40 @@ StackError_t stackPushBase(Stack_t *stk, stkElem_t val
 stkElem_t stackPopBase(Stack_t *stk
                 ON_DEBUG(, const char *file, int line, const char *name));
 
-StackError_t stackDumpBase(Stack_t *stk, const char *file, int line, const char *function);
+StackError_t stackPushNBase(Stack_t *stk, const stkElem_t *src, size_t n
+                ON_DEBUG(, const char *file, int line, const char *name));
+
+StackError_t stackPopNBase(Stack_t *stk, stkElem_t *out, size_t n
+                ON_DEBUG(, const char *file, int line, const char *name));
+
+StackError_t stackDumpBase(Stack_t *stk, const StackDumpOptions_t *options,
+                           const char *file, int line, const char *function);
+
+void stackDumpAllBase(const char *file, int line, const char *function);
+
+/// Used by snapshots: elements below size are unchanged since checkpoint with this tag
+StackError_t stackMarkCheckpoint(Stack_t *stk, uint64_t tag);
 
 /* -----------------ASSERTS FOR DEBUGGING-------------------------------------*/
+// Asserts are active in release too: amount of checking is chosen by StackVerifyLevel
+// Default level is VERIFY_FULL without NDEBUG and VERIFY_OFF with it
 
-#ifndef NDEBUG
-# define STACK_ASSERT(stk)                                                                              \
+#define STACK_ASSERT(stk)                                                                               \
     do {                                                                                                \
-        StackError_t stkError = stackVerify(stk);                                                       \
+        StackError_t stkError = stackCheck(stk);                                                        \
         if (stkError) {                                                                                 \
             logPrintWithTime(L_ZERO, 0, "Stack error occurred: %s\n", stackFirstErrorToStr(stkError));  \
             stackDump(stk);                                                                             \
-            MY_ASSERT(0, abort());                                                                      \
+            abort();                                                                                    \
         }                                                                                               \
     } while (0)
 
+#ifndef NDEBUG
 //! DO NOT USE THIS MACRO
 //! IT USES LOCAL VARIABLES NAME_, FILE_, LINE_
 # define STACK_VERBOSE_ASSERT(stk)                                                                      \
     do {                                                                                                \
-        StackError_t stkError = stackVerify(stk);                                                       \
+        StackError_t stkError = stackCheck(stk);                                                        \
         if (stkError) {                                                                                 \
             logPrintWithTime(L_ZERO, 1, "Stack \"%s\" error in %s:%d : %s\n",                           \
                             NAME_, FILE_, LINE_, stackFirstErrorToStr(stkError));                       \
@@ -156,8 +441,7 @@ StackError_t stackDumpBase(Stack_t *stk, const char *file, int line, const char
     } while (0)
 
 #else
-# define STACK_ASSERT(stk)
-# define STACK_VERBOSE_ASSERT(stk)
+# define STACK_VERBOSE_ASSERT(stk) STACK_ASSERT(stk)
 #endif
 
 #endif
@@ -0,0 +1,75 @@
+/// @file Elimination-backoff stack container
+/*------------------ELIMINATION-BACKOFF STACK---------------------------------*/
+/*------------------LOCK-FREE STACK WITH ELIMINATION ARRAY--------------------*/
+/*------------------orientiered-MIPT-2024-------------------------------------*/
+#ifndef ELIM_STACK_H
+#define ELIM_STACK_H
+
+#include "cStack.h"
+#include "lfStack.h"
+
+/*------------------STRUCTS AND CONSTANTS-------------------------------------*/
+
+const size_t ELIM_DEFAULT_SLOTS   = 16;     ///< default elimination array size
+const size_t ELIM_DEFAULT_BACKOFF = 128;    ///< default spins in elimination slot
+
+/// @brief How operations were completed
+typedef struct {
+    size_t centralPushes;                   ///< Pushes done on central stack
+    size_t centralPops;                     ///< Pops done on central stack
+    size_t eliminatedPushes;                ///< Pushes handed directly to pop
+    size_t eliminatedPops;                  ///< Pops that got value directly from push
+    size_t emptyPops;                       ///< Pops from empty stack
+} ElimStackStats_t;
+
+/*!
+    @brief Lock-free stack with elimination array
+
+    When CAS on central stack fails, push offers its node in random slot of elimination
+    array and waits there for backoffSpins; pop that comes to the same slot takes the node
+    without touching central stack. Slots are tagged like LfStack_t top, so withdrawn
+    and reused nodes can't be confused.
+*/
+typedef struct {
+    LfStack_t central;                      ///< Central stack, also owns all nodes
+    lfTagged_t *slots;                      ///< Offered push nodes (accessed atomically)
+    size_t slotsCount;                      ///< Size of elimination array
+    size_t backoffSpins;                    ///< Number of spins in elimination slot
+    bool eliminateFirst;                    ///< Try elimination array before central stack
+    alignas(64) ElimStackStats_t stats;     ///< Counters (accessed atomically), own cache line
+} ElimStack_t;
+
+/* -----------------FUNCTIONS TO WORK WITH STACK------------------------------*/
+// All functions except elimStackCtor and elimStackDtor are thread-safe
+
+/// @brief Construct empty stack
+/// @param slotsCount   Elimination array size, 0 for ELIM_DEFAULT_SLOTS
+/// @param backoffSpins Spins in elimination slot, 0 for ELIM_DEFAULT_BACKOFF
+StackError_t elimStackCtor(ElimStack_t *stk, size_t slotsCount, size_t backoffSpins);
+
+/// @brief Delete stack, no other thread may use it
+StackError_t elimStackDtor(ElimStack_t *stk);
+
+/// @brief Make push and pop try elimination array before central stack
+/// Push also yields CPU after offering node. Used to exercise elimination when threads
+/// rarely collide; call before stack is shared
+StackError_t elimStackSetEliminateFirst(ElimStack_t *stk, bool eliminateFirst);
+
+/// @brief Push element to stack
+StackError_t elimStackPush(ElimStack_t *stk, stkElem_t val);
+
+/// @brief Pop element from stack to val
+/// @return ERR_EMPTY if there's nothing to pop
+StackError_t elimStackPop(ElimStack_t *stk, stkElem_t *val);
+
+/// @brief Get top element of central stack to val
+/// @return ERR_EMPTY if central stack is empty
+StackError_t elimStackTop(ElimStack_t *stk, stkElem_t *val);
+
+/// @brief Get number of elements; may be outdated when returned
+size_t elimStackGetSize(ElimStack_t *stk);
+
+/// @brief Get snapshot of operation counters
+ElimStackStats_t elimStackGetStats(ElimStack_t *stk);
+
+#endif
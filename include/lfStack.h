@@ -0,0 +1,86 @@
+/// @file Lock-free stack container
+/*------------------LOCK-FREE STACK CONTAINER---------------------------------*/
+/*------------------TREIBER STACK WITH TAGGED POINTERS------------------------*/
+/*------------------orientiered-MIPT-2024-------------------------------------*/
+#ifndef LF_STACK_H
+#define LF_STACK_H
+
+#include "cStack.h"
+
+/*------------------STRUCTS AND CONSTANTS-------------------------------------*/
+
+/// @brief Node of lock-free stack
+/// Nodes are recycled through free list and freed only in lfStackDtor,
+/// so reading node that was popped by other thread is always safe
+typedef struct lfNode {
+    ON_CANARY(canary_t goose1;)                 ///< first canary
+    struct lfNode *next;                        ///< Next node (accessed atomically)
+    stkElem_t val;                              ///< Element (accessed atomically)
+    ON_CANARY(canary_t goose2;)                 ///< second canary
+} lfNode_t;
+
+/// @brief Node pointer in low 48 bits and ABA tag in high 16 bits
+/// Tag is incremented on every successful CAS
+typedef uint64_t lfTagged_t;
+
+typedef struct {
+    lfTagged_t top;                             ///< Top node (accessed atomically)
+    lfTagged_t freeList;                        ///< Recycled nodes (accessed atomically)
+    size_t size;                                ///< Number of elements (accessed atomically)
+} LfStack_t;
+
+/* -----------------FUNCTIONS TO WORK WITH STACK------------------------------*/
+// All functions except lfStackCtor and lfStackDtor are thread-safe
+
+/// @brief Construct empty stack
+StackError_t lfStackCtor(LfStack_t *stk);
+
+/// @brief Delete stack, no other thread may use it
+StackError_t lfStackDtor(LfStack_t *stk);
+
+/// @brief Push element to stack
+StackError_t lfStackPush(LfStack_t *stk, stkElem_t val);
+
+/// @brief Pop element from stack to val
+/// @return ERR_EMPTY if there's nothing to pop
+StackError_t lfStackPop(LfStack_t *stk, stkElem_t *val);
+
+/// @brief Get top element to val
+/// @return ERR_EMPTY if stack is empty
+StackError_t lfStackTop(LfStack_t *stk, stkElem_t *val);
+
+/// @brief Get number of elements; may be outdated when returned
+size_t lfStackGetSize(LfStack_t *stk);
+
+/* -----------------BASE LIBRARY FUNCTIONS; DO NOT USE------------------------*/
+
+const int      LF_TAG_SHIFT = 48;
+const uint64_t LF_PTR_MASK  = (1ull << LF_TAG_SHIFT) - 1;
+
+/// @brief Get node pointer from tagged value
+inline lfNode_t *lfTaggedPtr(lfTagged_t tagged) {
+    return (lfNode_t *) (tagged & LF_PTR_MASK);
+}
+
+/// @brief Make tagged value with node and tag of old value incremented
+inline lfTagged_t lfTaggedNext(lfTagged_t old, lfNode_t *node) {
+    return (((old >> LF_TAG_SHIFT) + 1) << LF_TAG_SHIFT) | (uint64_t) node;
+}
+
+/// @brief Take node from free list or allocate new one
+lfNode_t *lfNodeAlloc(LfStack_t *stk);
+
+/// @brief Return node to free list
+void lfNodeFree(LfStack_t *stk, lfNode_t *node);
+
+/// @brief Single CAS attempt to push node, false if CAS failed
+bool lfStackTryPush(LfStack_t *stk, lfNode_t *node);
+
+/// @brief Single CAS attempt to pop node
+/// @return STACK_OK and node, ERR_EMPTY, or ERR_LOGIC if CAS failed
+StackError_t lfStackTryPop(LfStack_t *stk, lfNode_t **node);
+
+/// @brief Check node canaries, abort if they are broken
+void lfNodeVerify(lfNode_t *node);
+
+#endif
@@ -0,0 +1,77 @@
+/// @file Binary log records with deferred formatting
+/*------------------BINARY LOG------------------------------------------------*/
+/*------------------PRINTF ARGUMENTS ARE STORED, TEXT IS MADE OFFLINE---------*/
+/*------------------orientiered MIPT 2024-------------------------------------*/
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+/*------------------STRUCTS AND CONSTANTS-------------------------------------*/
+
+const uint64_t LOG_BINARY_MAGIC       = 0x314E4942474F4C43;   ///< "CLOGBIN1"
+const size_t   LOG_BINARY_LOCAL_BYTES = 512;                  ///< Records are encoded on stack if they fit
+
+/// @brief Record types
+enum LogRecordType {
+    LOG_RECORD_SESSION = 'S',   ///< Start of session, forgets all formats
+    LOG_RECORD_FORMAT  = 'F',   ///< Format string with its ID
+    LOG_RECORD_MESSAGE = 'M'    ///< Format ID and arguments
+};
+
+/*!
+    @brief Header of every record, followed by len bytes
+
+    Format ID is address of format string in writer process, so format strings must be
+    string literals. Every thread writes format record before first message with it in
+    session, so decoder always knows format before it's used.
+
+    Arguments follow in order of conversions, '*' widths before their values:
+    int types as int32 (or int64 for l, ll, z, j, t), floating types as double
+    (or long double for L), pointers as uint64, strings as uint32 length and bytes
+    (UINT32_MAX for NULL). All numbers are in host byte order.
+*/
+typedef struct {
+    uint16_t type;                      ///< LogRecordType
+    uint16_t withTime;                  ///< Message is printed after timestamp
+    uint32_t len;                       ///< Bytes after header
+    uint64_t id;                        ///< Format ID, LOG_BINARY_MAGIC for session record
+    int64_t  timeNs;                    ///< CLOCK_REALTIME of message in nanoseconds
+} LogRecordHeader_t;
+
+/// @brief Growing buffer for record, stays on stack while it is small
+typedef struct {
+    char *data;                         ///< local or heap block
+    size_t size;                        ///< Bytes used
+    size_t capacity;                    ///< Size of data
+    char local[LOG_BINARY_LOCAL_BYTES]; ///< Initial block
+} LogRecordBuffer_t;
+
+/*------------------FUNCTIONS-------------------------------------------------*/
+
+/// @brief Prepare empty buffer
+void logRecordBufferInit(LogRecordBuffer_t *buffer);
+
+/// @brief Free heap block of buffer
+void logRecordBufferFree(LogRecordBuffer_t *buffer);
+
+/// @brief Append format record to buffer
+void logEncodeFormat(LogRecordBuffer_t *buffer, const char *fmt);
+
+/// @brief Append message record with arguments of fmt to buffer, args are not consumed
+void logEncodeMessage(LogRecordBuffer_t *buffer, bool withTime, int64_t timeNs, const char *fmt, va_list args);
+
+/// @brief Append session record to buffer
+void logEncodeSession(LogRecordBuffer_t *buffer, int64_t timeNs);
+
+/*!
+    @brief Print message as printf(fmt, ...) would print it
+
+    @param[in] args Encoded arguments of message record
+    @return false if arguments don't match format
+*/
+bool logDecodeMessage(FILE *out, const char *fmt, const char *args, size_t len);
+
+#endif
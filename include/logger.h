@@ -12,20 +12,107 @@ enum LogLevel {
     L_EXTRA     ///< Debug++
 };
 
+/// @brief Part of program message comes from, each has its own runtime log level
+enum LogSubsystem {
+    LOG_SUB_GENERAL,    ///< Everything else
+    LOG_SUB_STACK,      ///< Stack operations, checks and dumps
+    LOG_SUB_MEMORY,     ///< Allocators and data blocks
+    LOG_SUB_ARGV,       ///< Command line parsing
+    LOG_SUB_COUNT
+};
+
+/// Messages above this level are removed at compile time, define it before including logger.h to override
+#ifndef LOG_COMPILED_LEVEL
+# ifdef NDEBUG
+#  define LOG_COMPILED_LEVEL L_ZERO
+# else
+#  define LOG_COMPILED_LEVEL L_EXTRA
+# endif
+#endif
+
+/// Subsystem of logPrint and logPrintWithTime calls in translation unit, define it before including logger.h
+#ifndef LOG_SUBSYSTEM
+# define LOG_SUBSYSTEM LOG_SUB_GENERAL
+#endif
+
+/// @brief What async logger does with message that doesn't fit in ring of its thread
+enum LogOverflowPolicy {
+    LOG_OVERFLOW_BLOCK,     ///< Wait until writer thread frees space
+    LOG_OVERFLOW_DROP,      ///< Drop message silently
+    LOG_OVERFLOW_COUNT      ///< Drop message, writer thread reports number of dropped messages
+};
+
+const size_t LOG_RING_DEFAULT_BYTES = 1 << 16;      ///< Ring size of every thread used by logStartAsync
+
 /// @brief Open log file
 enum status logOpen();
 
-/// @brief Close log file
+/*!
+    @brief Open binary log file (log.bin) instead of log.txt
+
+    Messages are written as format ID, timestamp and raw printf arguments,
+    so they are not formatted by logging thread. Format strings must be string literals.
+    tools/logDecode turns file back into text of log.txt. Works in async mode too.
+*/
+enum status logOpenBinary();
+
+/// @brief Close log file, stops async mode first
 enum status logClose();
 
-/// @brief Set log level
+/*!
+    @brief Switch to asynchronous mode
+
+    Every thread formats messages into its own lock-free ring of ringBytes bytes,
+    background thread writes them to file in batches. Messages of one thread keep their order.
+    Rings are also written if process is killed by abort().
+*/
+enum status logStartAsync(enum LogOverflowPolicy policy, size_t ringBytes);
+
+/// @brief Write all messages, stop writer thread and return to synchronous mode
+enum status logStopAsync();
+
+/// @brief Wait until messages logged so far are written to file (no-op in synchronous mode)
+void logFlush();
+
+/// @brief Runtime log levels of subsystems, read by LOG_ENABLED
+extern enum LogLevel logSubsystemLevels[LOG_SUB_COUNT];
+
+struct timespec;
+
+/// @brief Print "[dd.mm.yyyy hh:mm:ss.uuuuuu] " prefix of messages with time
+/// @return Length of prefix
+size_t logFormatTime(char *buffer, size_t size, const struct timespec *time);
+
+/// @brief Set log level of all subsystems
 void setLogLevel(enum LogLevel level);
 
-/// @brief Print in log file with time signature
-enum status logPrintWithTime(enum LogLevel level, bool copyToStderr, const char* fmt, ...) __attribute__( (format( printf, 3, 4 ) ) );
+/// @brief Set log level of one subsystem
+void setLogSubsystemLevel(enum LogSubsystem subsystem, enum LogLevel level);
+
+/// @brief Is message of level from subsystem written; constant false if level is above LOG_COMPILED_LEVEL
+#define LOG_ENABLED(subsystem, level) ((level) <= LOG_COMPILED_LEVEL && (level) <= logSubsystemLevels[subsystem])
+
+/// @brief Print in log file with time signature, arguments are not evaluated if level is disabled
+#define logPrintWithTime(level, copyToStderr, ...)                                                  \
+    do {                                                                                            \
+        if (LOG_ENABLED(LOG_SUBSYSTEM, level))                                                      \
+            logPrintWithTimeBase(copyToStderr, __VA_ARGS__);                                        \
+    } while(0)
+
+/// @brief Print in log file, arguments are not evaluated if level is disabled
+#define logPrint(level, copyToStderr, ...)                                                          \
+    do {                                                                                            \
+        if (LOG_ENABLED(LOG_SUBSYSTEM, level))                                                      \
+            logPrintBase(copyToStderr, __VA_ARGS__);                                                \
+    } while(0)
+
+/*------------------BASE FUNCTIONS (USE MACROS INSTEAD)-----------------------*/
+
+/// @brief Print in log file with time signature, level is checked by caller
+enum status logPrintWithTimeBase(bool copyToStderr, const char* fmt, ...) __attribute__( (format( printf, 2, 3 ) ) );
 
-/// @brief Print in log file
-enum status logPrint(enum LogLevel level, bool copyToStderr, const char* fmt, ...) __attribute__( (format( printf, 3, 4 ) ) );
+/// @brief Print in log file, level is checked by caller
+enum status logPrintBase(bool copyToStderr, const char* fmt, ...) __attribute__( (format( printf, 2, 3 ) ) );
 
 /// @brief Print in log file with place in code
 #define LOG_PRINT(level, ...)                                                                       \
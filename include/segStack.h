@@ -0,0 +1,85 @@
+/// @file Segmented stack container
+/*------------------SEGMENTED STACK CONTAINER---------------------------------*/
+/*------------------CHAIN OF FIXED-SIZE CHUNKS--------------------------------*/
+/*------------------orientiered-MIPT-2024-------------------------------------*/
+#ifndef SEG_STACK_H
+#define SEG_STACK_H
+
+#include "cStack.h"
+
+/*------------------STRUCTS AND CONSTANTS-------------------------------------*/
+
+const size_t SEG_CHUNK_BYTES = 4096;    ///< Size of chunk with canaries and link, fits pool size class
+const size_t SEG_CHUNK_ELEMS = (SEG_CHUNK_BYTES - 3 * sizeof(uint64_t)) / sizeof(stkElem_t);
+
+/// @brief Chunk of segmented stack, chunks are linked from top to bottom
+typedef struct segChunk {
+    ON_CANARY(canary_t goose1;)                 ///< first canary
+    struct segChunk *prev;                      ///< Chunk below this one
+    stkElem_t elems[SEG_CHUNK_ELEMS];           ///< Elements
+    ON_CANARY(canary_t goose2;)                 ///< second canary
+} segChunk_t;
+
+/*!
+    @brief Stack stored in chain of fixed-size chunks
+
+    Elements are never moved, so pointers to them stay valid until they are popped,
+    and size is limited only by memory. Chunk emptied by pop is kept as spare,
+    so push/pop at chunk border doesn't allocate.
+*/
+typedef struct {
+    ON_CANARY(canary_t goose1;)                 ///< first canary
+    segChunk_t *top;                            ///< Chunk with top element
+    segChunk_t *spare;                          ///< Empty chunk kept for next push
+    size_t topCount;                            ///< Elements in top chunk
+    size_t chunksCount;                         ///< Chunks in chain (spare is not counted)
+    size_t size;                                ///< Number of elements
+    const StackAllocator_t *allocator;          ///< Allocator of chunks
+    ON_HASH(hash_t stackHash;)                  ///< Hash of struct itself
+    ON_CANARY(canary_t goose2;)                 ///< second canary
+} SegStack_t;
+
+/* -----------------FUNCTIONS TO WORK WITH STACK------------------------------*/
+
+/// @brief Construct empty stack, allocator NULL means stackGetDefaultAllocator()
+StackError_t segStackCtor(SegStack_t *stk, const StackAllocator_t *allocator);
+
+/// @brief Delete stack and all its chunks
+StackError_t segStackDtor(SegStack_t *stk);
+
+/// @brief Push element to stack
+StackError_t segStackPush(SegStack_t *stk, stkElem_t val);
+
+/// @brief Pop element from stack
+/// You can't use this function when size is 0
+stkElem_t segStackPop(SegStack_t *stk);
+
+/// @brief Pointer to top element, valid until it is popped
+/// You can't use this function when size is 0
+stkElem_t *segStackTop(SegStack_t *stk);
+
+/// @brief Get number of elements
+size_t segStackGetSize(SegStack_t *stk);
+
+/// @brief Check stack and canaries of all chunks
+StackError_t segStackVerify(SegStack_t *stk);
+
+/// @brief O(1) check used on every operation: sizes, struct hash, canaries of top and spare chunks
+StackError_t segStackCheck(SegStack_t *stk);
+
+/// @brief Wright stack dump in log file
+#define segStackDump(stk) segStackDumpBase(stk, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+StackError_t segStackDumpBase(SegStack_t *stk, const char *file, int line, const char *function);
+
+#define SEG_STACK_ASSERT(stk)                                                                           \
+    do {                                                                                                \
+        StackError_t stkError = segStackCheck(stk);                                                     \
+        if (stkError) {                                                                                 \
+            logPrintWithTime(L_ZERO, 0, "SegStack error occurred: %s\n", stackFirstErrorToStr(stkError)); \
+            segStackDump(stk);                                                                          \
+            abort();                                                                                    \
+        }                                                                                               \
+    } while (0)
+
+#endif
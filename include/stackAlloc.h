@@ -0,0 +1,92 @@
+/// @file Allocators for stack data blocks
+#ifndef STACK_ALLOC_H
+#define STACK_ALLOC_H
+
+/*------------------STRUCTS DEFINITIONS---------------------------------------*/
+
+/*!
+    @brief Allocator for stack data blocks
+
+    Sizes of blocks are always passed back to allocator, so it doesn't need headers.
+    Blocks are not zeroed; stack fills them with canaries and poison itself.
+*/
+typedef struct StackAllocator {
+    const char *name;                                                       ///< Name for logs
+    void *(*alloc)  (void *ctx, size_t bytes);                              ///< Allocate block
+    void *(*realloc)(void *ctx, void *block, size_t oldBytes, size_t newBytes); ///< Resize block
+    void  (*free)   (void *ctx, void *block, size_t bytes);                 ///< Free block
+    void *ctx;                                                              ///< Passed to all functions
+} StackAllocator_t;
+
+/// @brief malloc/realloc/free
+extern const StackAllocator_t STACK_MALLOC_ALLOCATOR;
+
+/*!
+    @brief Size-class pool
+
+    Blocks up to POOL_MAX_CLASS_BYTES are rounded up to power of two and cached in
+    thread-local free lists when freed, so short-lived stacks reuse memory instead of
+    going to malloc, and growth within one class doesn't move data. Cache of a class
+    holds at most POOL_MAX_CACHED blocks and POOL_MAX_CACHED_BYTES, so a thread keeps
+    about 2 MB at most; use stackPoolTrim to return it earlier.
+*/
+extern const StackAllocator_t STACK_POOL_ALLOCATOR;
+
+/*!
+    @brief Every block in its own mapping between PROT_NONE guard pages
+
+    Block ends right at trailing guard page (its start is aligned to at most 16 bytes),
+    so writing past it faults on the offending instruction instead of being found by
+    later stackVerify, and push and pop check nothing. Reallocation resizes mapping
+    with mremap, but block still has to be moved inside it to stay at the guard page,
+    so every resize copies the block: O(n). Define STACK_GUARD_PAGES to make it
+    default allocator.
+*/
+extern const StackAllocator_t STACK_GUARD_ALLOCATOR;
+
+/// @brief Guard pages with block starting right after leading guard page, catches underruns instead
+/// Block doesn't move inside mapping, so resize that changes number of pages copies nothing
+extern const StackAllocator_t STACK_GUARD_BELOW_ALLOCATOR;
+
+const size_t POOL_MIN_CLASS_BYTES = 64;         ///< Smallest size class
+const size_t POOL_MAX_CLASS_BYTES = 1 << 20;    ///< Bigger blocks go directly to malloc
+const size_t POOL_MAX_CACHED      = 64;         ///< Free blocks cached per class per thread
+const size_t POOL_MAX_CACHED_BYTES = 1 << 18;   ///< Bytes cached per class per thread, bigger classes aren't cached
+
+const size_t STACK_FILE_HEADER_BYTES = 4096;     ///< Header page before data block in mapped file
+
+/*!
+    @brief File mapped with mmap: header page followed by one data block
+
+    Its allocator grows and shrinks file with ftruncate and mapping with mremap,
+    so data block persists after process exits. Mapping may move on every change.
+*/
+typedef struct {
+    int fd;                                     ///< Mapped file
+    char *base;                                 ///< Start of mapping (header)
+    size_t blockBytes;                          ///< Size of data block after header
+    StackAllocator_t allocator;                 ///< Allocator of the only data block, ctx is this mapping
+} StackFileMap_t;
+
+/*------------------FUNCTIONS-------------------------------------------------*/
+
+/// @brief Get allocator used by stackCtor (STACK_POOL_ALLOCATOR by default)
+const StackAllocator_t *stackGetDefaultAllocator();
+
+/// @brief Set allocator used by stackCtor
+void stackSetDefaultAllocator(const StackAllocator_t *allocator);
+
+/// @brief Free all blocks cached by current thread
+void stackPoolTrim();
+
+/// @brief Open or create file and map it; header of new file is zeroed
+/// @return NULL if file can't be opened or mapped
+StackFileMap_t *stackFileMapOpen(const char *path);
+
+/// @brief Flush mapping to file
+int stackFileMapSync(StackFileMap_t *map);
+
+/// @brief Unmap and close file, file keeps its contents
+void stackFileMapClose(StackFileMap_t *map);
+
+#endif
@@ -0,0 +1,70 @@
+/// @file Binary snapshots of Stack_t
+/*------------------STACK SNAPSHOTS-------------------------------------------*/
+/*------------------VERSIONED BINARY FORMAT WITH CHECKSUMS--------------------*/
+/*------------------orientiered-MIPT-2024-------------------------------------*/
+#ifndef STACK_SNAPSHOT_H
+#define STACK_SNAPSHOT_H
+
+#include "cStack.h"
+
+/*------------------STRUCTS AND CONSTANTS-------------------------------------*/
+
+const uint64_t STACK_SNAPSHOT_MAGIC   = 0x3150534E4B545343;   ///< "CSTKSNP1"
+const uint32_t STACK_SNAPSHOT_VERSION = 2;                    ///< Incremented on every format change
+const size_t   SNAPSHOT_BLOCK_BYTES   = 1 << 20;              ///< Checksum block and read buffer size
+
+/// @brief What record contains
+enum StackSnapshotKind {
+    SNAPSHOT_FULL = 0,      ///< All elements
+    SNAPSHOT_DELTA          ///< Elements above those unchanged since previous record
+};
+
+/*!
+    @brief Header written before elements
+
+    Elements follow header as raw array of count * elemSize bytes in host byte order.
+    dataChecksum is sum of hashes of blockBytes blocks (block index is seed),
+    so it is computed while data is streamed. Both checksums use hashBackend of writer,
+    reader doesn't have to select the same memHash backend.
+
+    Delta record is applied to stack restored from record with headerChecksum == baseTag:
+    stack is cut to keep elements and record elements are pushed.
+*/
+typedef struct {
+    uint64_t magic;                             ///< STACK_SNAPSHOT_MAGIC
+    uint32_t version;                           ///< STACK_SNAPSHOT_VERSION
+    uint32_t elemSize;                          ///< sizeof(stkElem_t) of writer
+    uint32_t kind;                              ///< StackSnapshotKind
+    uint32_t hashBackend;                       ///< MemHashBackend of checksums
+    uint64_t blockBytes;                        ///< SNAPSHOT_BLOCK_BYTES of writer
+    uint64_t baseTag;                           ///< headerChecksum of previous record, 0 for full one
+    uint64_t keep;                              ///< Elements kept from previous record, 0 for full one
+    uint64_t count;                             ///< Number of elements in record
+    uint64_t dataChecksum;                      ///< Checksum of elements
+    uint64_t headerChecksum;                    ///< Hash of header with headerChecksum = 0
+} StackSnapshotHeader_t;
+
+/*------------------FUNCTIONS-------------------------------------------------*/
+
+/// @brief Write full snapshot of stack to fd at its current position
+/// Header and elements are written with one writev, fd is not closed.
+/// Snapshot becomes checkpoint for stackSaveDelta.
+/// @return ERR_FILE if write failed
+StackError_t stackSave(Stack_t *stk, int fd);
+
+/// @brief Write elements changed since last stackSave or stackSaveDelta
+/// Only [lowWater, size) is written, so I/O is proportional to what changed.
+/// Stack that was never saved or loaded gets full snapshot.
+/// @return ERR_FILE if write failed
+StackError_t stackSaveDelta(Stack_t *stk, int fd);
+
+/// @brief Read record from current position of fd and apply it to stack
+/// Full snapshot is pushed bottom first on top of existing elements, so snapshots saved
+/// to one fd one after another are loaded back in the same order. Delta records are
+/// accepted only after record they were written after, by stack that was empty
+/// before its full snapshot was loaded. Stack is unchanged on error.
+/// @return ERR_FILE if record can't be read or has wrong format, ERR_HASH_STACK if header
+///         is broken or delta doesn't follow last record, ERR_HASH_DATA if elements are broken
+StackError_t stackLoad(Stack_t *stk, int fd);
+
+#endif
@@ -0,0 +1,390 @@
+/// @file Type-generic stack container
+/*------------------TEMPLATE STACK CONTAINER----------------------------------*/
+/*------------------WITH CANARY AND HASH PROTECTION---------------------------*/
+/*------------------orientiered-MIPT-2024-------------------------------------*/
+#ifndef T_STACK_H
+#define T_STACK_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "utils.h"
+#include "cStack.h"
+
+/*------------------PROTECTION POLICIES---------------------------------------*/
+
+/// @brief Full protection: canaries, hashes and verification on every operation
+struct StackDebugPolicy {
+    static const bool canary = true;        ///< canaries around object and data
+    static const bool hash   = true;        ///< data and object hashes
+    static const bool verify = true;        ///< verify before and after every operation
+};
+
+/// @brief No protection at all
+struct StackReleasePolicy {
+    static const bool canary = false;
+    static const bool hash   = false;
+    static const bool verify = false;
+};
+
+#ifndef NDEBUG
+typedef StackDebugPolicy StackDefaultPolicy;
+#else
+typedef StackReleasePolicy StackDefaultPolicy;
+#endif
+
+/*------------------ELEMENT TRAITS--------------------------------------------*/
+
+/// @brief Poison value and formatter for stack element type
+/// Specialize it for your type to get readable dumps
+/// Default poison is 0xAB byte pattern, default formatter prints bytes in hex
+template <typename T>
+struct StackElemTraits {
+    static T poison() {
+        static_assert(std::is_trivially_copyable<T>::value, "Poison is available only for trivially copyable types");
+        T val;
+        memset((void *) &val, 0xAB, sizeof(T));
+        return val;
+    }
+    static int format(char *buf, size_t bufSize, const T &val) {
+        if constexpr (!std::is_trivially_copyable<T>::value)
+            return snprintf(buf, bufSize, "<%zu bytes>", sizeof(T));
+        int written = 0;
+        const unsigned char *bytes = (const unsigned char *) &val;
+        for (size_t idx = 0; idx < sizeof(T) && (size_t) written + 2 < bufSize; idx++)
+            written += snprintf(buf + written, bufSize - (size_t) written, "%.2X", bytes[sizeof(T) - idx - 1]);
+        return written;
+    }
+};
+
+#define STACK_ELEM_TRAITS(type, poisonVal, fmt)                                 \
+    template <>                                                                 \
+    struct StackElemTraits<type> {                                              \
+        static type poison() { return poisonVal; }                              \
+        static int format(char *buf, size_t bufSize, const type &val) {         \
+            return snprintf(buf, bufSize, fmt, val);                            \
+        }                                                                       \
+    }
+
+STACK_ELEM_TRAITS(int,                  (int) 0xA2DDEAD3,               "%d");
+STACK_ELEM_TRAITS(unsigned,             0xA2DDEAD3u,                    "%u");
+STACK_ELEM_TRAITS(long,                 0x2BADF00DA2DDEAD3,             "%ld");
+STACK_ELEM_TRAITS(unsigned long,        0xABADF00DA2DDEAD3ul,           "%lu");
+STACK_ELEM_TRAITS(long long,            0x2BADF00DA2DDEAD3ll,           "%lld");
+STACK_ELEM_TRAITS(unsigned long long,   0xABADF00DA2DDEAD3ull,          "%llu");
+STACK_ELEM_TRAITS(char,                 0x7F,                           "%c");
+STACK_ELEM_TRAITS(float,                -1.2345e-29f,                   "%g");
+STACK_ELEM_TRAITS(double,               -1.2345678e-299,                "%g");
+
+#undef STACK_ELEM_TRAITS
+
+template <typename T>
+struct StackElemTraits<T *> {
+    static T *poison() { return (T *) (uintptr_t) 0xABADF00DA2DDEAD3; }
+    static int format(char *buf, size_t bufSize, T * const &val) {
+        return snprintf(buf, bufSize, "%p", (const void *) val);
+    }
+};
+
+/*------------------STACK TEMPLATE--------------------------------------------*/
+
+/*!
+    @brief Stack of elements of type T
+
+    Trivially copyable types are grown with realloc and poisoned like Stack_t,
+    other types are move constructed into new buffer and destroyed on pop.
+    Hashes are available only for trivially copyable types.
+*/
+template <typename T, typename Policy = StackDefaultPolicy, typename Traits = StackElemTraits<T> >
+class Stack {
+  public:
+    explicit Stack(size_t startCapacity = 0) :
+        goose1(0), size(0), capacity(0), data(NULL), dataHash(), stackHash(0), goose2(0)
+    {
+        if (Policy::canary)
+            goose1 = goose2 = (canary_t) this ^ CANARY_XOR;
+        if (startCapacity)
+            resize(startCapacity);
+        dataHash = memChunkHashCompute(NULL, 0);
+        rehashStack();
+        assertOk("Stack()");
+    }
+
+    Stack(const Stack &) = delete;
+    Stack &operator=(const Stack &) = delete;
+
+    ~Stack() {
+        assertOk("~Stack()");
+        destroyRange(0, size);
+        freeBlock(data);
+        data = NULL;
+        size = capacity = 0;
+    }
+
+    void push(const T &val) { emplace(val); }
+    void push(T &&val)      { emplace(std::move(val)); }
+
+    /// @brief Construct element in place on top of stack
+    template <typename... Args>
+    T &emplace(Args&&... args) {
+        assertOk("emplace");
+        T *elem = NULL;
+        if (size >= capacity) {
+            // Args may refer to element of stack, so it is built before old block is freed
+            T val(std::forward<Args>(args)...);
+            resize((2 * capacity > ALLOC_MIN) ? 2 * capacity : ALLOC_MIN);
+            elem = new (data + size) T(std::move(val));
+        } else
+            elem = new (data + size) T(std::forward<Args>(args)...);
+        size++;
+        if (hashed)
+            memChunkHashGrow(&dataHash, data, (size - 1) * sizeof(T), size * sizeof(T));
+        rehashStack();
+        assertOk("emplace");
+        return *elem;
+    }
+
+    /// @brief Push n elements, copying them with memcpy if possible
+    void pushN(const T *src, size_t n) {
+        assertOk("pushN");
+        MY_ASSERT(src || n == 0, abort());
+        if (size + n > capacity) {
+            // src may point into stack itself, then it follows elements to new block
+            bool inside = src >= data && src < data + size;
+            size_t offset = inside ? (size_t) (src - data) : 0;
+            resize((2 * capacity > size + n) ? 2 * capacity : size + n);
+            if (inside)
+                src = data + offset;
+        }
+
+        if constexpr (std::is_trivially_copyable<T>::value)
+            memcpy((void *) (data + size), src, n * sizeof(T));
+        else
+            for (size_t idx = 0; idx < n; idx++)
+                new (data + size + idx) T(src[idx]);
+        if (hashed)
+            memChunkHashGrow(&dataHash, data, size * sizeof(T), (size + n) * sizeof(T));
+        size += n;
+        rehashStack();
+        assertOk("pushN");
+    }
+
+    /// @brief Pop element from stack
+    /// You can't use this function when size is 0
+    T pop() {
+        assertOk("pop");
+        MY_ASSERT(size > 0, abort());
+
+        T val(std::move(data[size - 1]));
+        if (hashed)
+            memChunkHashShrink(&dataHash, data, size * sizeof(T), (size - 1) * sizeof(T));
+        destroyRange(size - 1, size);
+        size--;
+
+        if (size > DEALLOC_MIN && 4 * size < capacity)
+            resize(capacity / 2);
+        rehashStack();
+        assertOk("pop");
+        return val;
+    }
+
+    T &top() {
+        assertOk("top");
+        MY_ASSERT(size > 0, abort());
+        return data[size - 1];
+    }
+
+    size_t getSize() const { return size; }
+    size_t getCapacity() const { return capacity; }
+
+    /// @brief Make sure stack can hold newCapacity elements without reallocation
+    void reserve(size_t newCapacity) {
+        assertOk("reserve");
+        if (newCapacity > capacity)
+            resize(newCapacity);
+        rehashStack();
+        assertOk("reserve");
+    }
+
+    /// @brief Check stack for errors, return StackErrors bitmask
+    StackError_t verify() const {
+        StackError_t err = STACK_OK;
+        if (size > capacity)
+            err |= ERR_LOGIC;
+        if ((capacity > 0) ^ bool(data))
+            err |= ERR_DATA;
+
+        if (Policy::hash) {
+            if (stackHash != getStackHash())
+                err |= ERR_HASH_STACK;
+            if (hashed && !(err & (ERR_DATA + ERR_LOGIC + ERR_HASH_STACK)) && !memChunkHashEqual(dataHash, getDataHash()))
+                err |= ERR_HASH_DATA;
+        }
+        if (Policy::canary) {
+            if (!canaryOk(goose1, this))
+                err |= ERR_CANARY_LEFT;
+            if (!canaryOk(goose2, this))
+                err |= ERR_CANARY_RIGHT;
+            if (data && !(err & (ERR_DATA + ERR_HASH_STACK))) {
+                char *block = (char *) data - HEAD_SIZE;
+                if (!canaryOk(*(canary_t *) (block + HEAD_SIZE - sizeof(canary_t)), block))
+                    err |= ERR_DATA_CANARY_LEFT;
+                if (!canaryOk(*(canary_t *) (block + tailOffset(capacity)), block))
+                    err |= ERR_DATA_CANARY_RIGHT;
+            }
+        }
+        return err;
+    }
+
+    /// @brief Wright stack dump in log file
+    void dump(const char *file = __builtin_FILE(), int line = __builtin_LINE(),
+              const char *function = __builtin_FUNCTION()) const {
+        StackError_t err = verify();
+        logPrintWithTime(L_ZERO, 0, "Stack<%zu-byte elem> dump:\n", sizeof(T));
+        logPrint(L_ZERO, 0, "called from %s:%d (%s)\n", file, line, function);
+        logPrint(L_ZERO, 0, "[%p] {\n", this);
+        logPrint(L_ZERO, 0, "\terr      = %s\n", stackFirstErrorToStr(err));
+        logPrint(L_ZERO, 0, "\tsize     = %zu\n", size);
+        logPrint(L_ZERO, 0, "\tcapacity = %zu\n", capacity);
+        if (Policy::hash) {
+            logPrint(L_ZERO, 0, "\tdataHash  = %#.16lX:%#.16lX\n", dataHash.chunks, dataHash.tail);
+            logPrint(L_ZERO, 0, "\tstackHash = %#.16lX\n", stackHash);
+        }
+
+        logPrint(L_ZERO, 0, "\tdata[%p] {\n", (void *) data);
+        if (err & (ERR_DATA + ERR_LOGIC + ERR_HASH_STACK))
+            logPrint(L_ZERO, 0, "\t!!!Data may be corrupted!!!\n");
+        else {
+            char elemStr[64] = "";
+            for (size_t index = 0; index < size; index++) {
+                Traits::format(elemStr, sizeof(elemStr), data[index]);
+                logPrint(L_ZERO, 0, "\t* [%3zu] %s\n", index, elemStr);
+            }
+            if (poisoned && size < capacity)
+                logPrint(L_ZERO, 0, "\t  [%3zu..%3zu] (POISON)\n", size, capacity - 1);
+        }
+        logPrint(L_ZERO, 0, "\t}\n}\n");
+    }
+
+  private:
+    typedef uint64_t canary_t;
+    typedef uint64_t hash_t;
+
+    static const bool hashed   = Policy::hash && std::is_trivially_copyable<T>::value;
+    static const bool poisoned = std::is_trivially_copyable<T>::value;
+    static const canary_t CANARY_XOR = 0xEDABEDAF8A40FF15;
+    static const size_t ALLOC_MIN   = 5;
+    static const size_t DEALLOC_MIN = 5;
+    // Data canary is placed right before data, so head must keep data aligned
+    static const size_t HEAD_SIZE = (alignof(T) > sizeof(canary_t)) ? alignof(T) : sizeof(canary_t);
+
+    static_assert(alignof(T) <= alignof(max_align_t), "Overaligned types are not supported");
+
+    canary_t goose1;                ///< first canary
+    size_t size;                    ///< Number of elements in stack
+    size_t capacity;                ///< Size of reserved memory
+    T *data;                        ///< Array with elements
+    memChunkHash_t dataHash;        ///< Hash of elements in [0, size)
+    hash_t stackHash;               ///< Hash of size, capacity and data pointer
+    canary_t goose2;                ///< second canary
+
+    static bool canaryOk(canary_t canary, const void *ptr) {
+        return (canary ^ CANARY_XOR) == (canary_t) ptr;
+    }
+
+    static size_t tailOffset(size_t len) {
+        size_t bytes = HEAD_SIZE + len * sizeof(T);
+        return bytes + (sizeof(canary_t) - bytes % sizeof(canary_t)) % sizeof(canary_t);
+    }
+
+    static size_t blockSize(size_t len) {
+        return tailOffset(len) + (Policy::canary ? sizeof(canary_t) : 0);
+    }
+
+    static void freeBlock(T *ptr) {
+        if (ptr) free((char *) ptr - HEAD_SIZE);
+    }
+
+    static void fillCanaries(char *block, size_t len) {
+        if (!Policy::canary) return;
+        *(canary_t *) (block + HEAD_SIZE - sizeof(canary_t)) = (canary_t) block ^ CANARY_XOR;
+        *(canary_t *) (block + tailOffset(len))              = (canary_t) block ^ CANARY_XOR;
+    }
+
+    memChunkHash_t getDataHash() const {
+        return memChunkHashCompute(data, size * sizeof(T));
+    }
+
+    hash_t getStackHash() const {
+        hash_t hash = MEM_HASH_SEED;
+        hash = memHashSeeded(&size,     sizeof(size),     hash);
+        hash = memHashSeeded(&capacity, sizeof(capacity), hash);
+        hash = memHashSeeded(&data,     sizeof(data),     hash);
+        return memHashSeeded(&dataHash, sizeof(dataHash), hash);
+    }
+
+    void rehashStack() {
+        if (Policy::hash)
+            stackHash = getStackHash();
+    }
+
+    void assertOk(const char *operation) const {
+        if (!Policy::verify) return;
+        StackError_t err = verify();
+        if (err) {
+            logPrintWithTime(L_ZERO, 1, "Stack<%zu-byte elem>[%p] error in %s: %s\n",
+                             sizeof(T), this, operation, stackFirstErrorToStr(err));
+            dump();
+            abort();
+        }
+    }
+
+    void destroyRange(size_t from, size_t to) {
+        if constexpr (poisoned) {
+            T poison = Traits::poison();
+            memValSet(data + from, &poison, sizeof(T), to - from);
+        } else
+            for (size_t idx = from; idx < to; idx++)
+                data[idx].~T();
+    }
+
+    /// Trivially copyable elements are moved by realloc, others one by one
+    void resize(size_t newCapacity) {
+        MY_ASSERT(newCapacity >= size, abort());
+        logPrintWithTime(L_DEBUG, 0, "Reallocating Stack<%zu-byte elem>[%p] data: %zu --> %zu\n",
+                         sizeof(T), this, capacity, newCapacity);
+        char *block = NULL;
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            block = (char *) realloc(data ? (char *) data - HEAD_SIZE : NULL, blockSize(newCapacity));
+            MY_ASSERT(block, abort());
+        } else {
+            block = (char *) malloc(blockSize(newCapacity));
+            MY_ASSERT(block, abort());
+            T *newData = (T *) (block + HEAD_SIZE);
+            for (size_t idx = 0; idx < size; idx++) {
+                new (newData + idx) T(std::move(data[idx]));
+                data[idx].~T();
+            }
+            freeBlock(data);
+        }
+        data = (T *) (block + HEAD_SIZE);
+        if constexpr (poisoned) {
+            if (newCapacity > capacity) {
+                T poison = Traits::poison();
+                memValSet(data + capacity, &poison, sizeof(T), newCapacity - capacity);
+            }
+        }
+        capacity = newCapacity;
+        fillCanaries(block, capacity);
+    }
+};
+
+#endif
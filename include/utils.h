@@ -33,10 +33,26 @@ typedef struct voidPtrPair {
 long long maxINT(long long a, long long b);
 long long minINT(long long a, long long b);
 
+/// @brief Instruction sets used by swap and memValSet
+enum SimdLevel {
+    SIMD_SCALAR = 0,        ///< 8-byte words
+    SIMD_SSE2,              ///< 16-byte registers
+    SIMD_AVX2               ///< 32-byte registers
+};
+
+/// @brief Best level supported by CPU
+enum SimdLevel getSimdLevel();
+
+/// @brief Limit level used by swap and memValSet (it is detected on first call otherwise)
+/// @return Level actually set: min(level, getSimdLevel())
+enum SimdLevel setSimdLevel(enum SimdLevel level);
+
+/// @brief Swap len bytes, a and b must not overlap
 void swap(void* a, void* b, size_t len);
 void swapByByte(void* a, void* b, size_t len);
 
 /// @brief memset with multiple byte values
+/// Element is doubled up to register width if its size divides 32, otherwise filled part is copied forward
 void memValSet(void *start, const void *elem, size_t elemSize, size_t length);
 
 /// @brief Incrementally compute standard deviation
@@ -46,7 +62,71 @@ void memValSet(void *start, const void *elem, size_t elemSize, size_t length);
 /// getResult < 0 --> reset stored values <br>
 doublePair_t runningSTD(double value, int getResult);
 
-/// @brief djb2 hash for any data
+/*------------------HASHES----------------------------------------------------*/
+
+/// @brief Algorithms behind memHash and memHashSeeded
+enum MemHashBackend {
+    MEM_HASH_DJB2 = 0,      ///< Byte-serial djb2, ~1 byte per cycle
+    MEM_HASH_XXH64,         ///< xxHash64: four independent 64-bit lanes
+    MEM_HASH_CRC32C         ///< Two interleaved CRC32C lanes, SSE4.2 instruction if CPU has it
+};
+
+#ifndef MEM_HASH_DEFAULT
+#define MEM_HASH_DEFAULT MEM_HASH_XXH64    ///< Backend used until setMemHashBackend is called
+#endif
+
+/// @brief Set backend of memHash and memHashSeeded
+/// All stored hashes become invalid, so call it before any hash-protected object is created
+void setMemHashBackend(enum MemHashBackend backend);
+
+/// @brief Get backend of memHash and memHashSeeded
+enum MemHashBackend getMemHashBackend();
+
+/// @brief Hash for any data with selected backend
 uint64_t memHash(const void *arr, size_t len);
 
+/// @brief Hash with selected backend, different seeds give independent hashes
+uint64_t memHashSeeded(const void *arr, size_t len, uint64_t seed);
+
+/// @brief Hash with given backend, independent of selected one (for data stored in files)
+/// @return 0 for unknown backend
+uint64_t memHashWithBackend(enum MemHashBackend backend, const void *arr, size_t len, uint64_t seed);
+
+/// @brief Initial value of djb2 hash (hash of empty array)
+const uint64_t MEM_HASH_SEED = 5381;
+
+/// @brief Continue djb2 hash with len more bytes from arr
+/// memHashAppend(memHashAppend(MEM_HASH_SEED, a, n), a + n, m) == memHashAppend(MEM_HASH_SEED, a, n + m)
+uint64_t memHashAppend(uint64_t hash, const void *arr, size_t len);
+
+/// @brief Remove len last bytes (stored in arr) from djb2 hash
+/// memHashRemove(memHashAppend(hash, a, n + m), a + n, m) == memHashAppend(hash, a, n)
+uint64_t memHashRemove(uint64_t hash, const void *arr, size_t len);
+
+const size_t MEM_HASH_CHUNK = 256;      ///< Chunk size of memChunkHash_t in bytes
+
+/*!
+    @brief Hash of array that grows and shrinks at the end
+
+    Full chunks are hashed with memHashSeeded (chunk index is seed) and summed,
+    so they are verified at speed of backend. Bytes after last full chunk are kept in
+    djb2, which can be updated in O(1) when array changes by a few bytes.
+*/
+typedef struct {
+    uint64_t chunks;                    ///< Sum of hashes of full chunks
+    uint64_t tail;                      ///< djb2 of bytes after last full chunk
+} memChunkHash_t;
+
+/// @brief Hash of len bytes from arr
+memChunkHash_t memChunkHashCompute(const void *arr, size_t len);
+
+/// @brief Update hash of arr after it grew from oldLen to newLen bytes
+void memChunkHashGrow(memChunkHash_t *hash, const void *arr, size_t oldLen, size_t newLen);
+
+/// @brief Update hash of arr before it shrinks from oldLen to newLen bytes
+void memChunkHashShrink(memChunkHash_t *hash, const void *arr, size_t oldLen, size_t newLen);
+
+/// @brief true if hashes are equal
+bool memChunkHashEqual(memChunkHash_t a, memChunkHash_t b);
+
 #endif
@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUB_ARGV
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -1,17 +1,47 @@
+#define LOG_SUBSYSTEM LOG_SUB_STACK
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <thread>
 
 #include "error_debug.h"
 #include "logger.h"
 #include "utils.h"
 #include "cStack.h"
 
-const size_t DEALLOC_MIN_SIZE = 5;
-const size_t ALLOC_MIN_SIZE = 5;
-const size_t MAX_STACK_SIZE = 1 << 28;
+#if defined(__SANITIZE_ADDRESS__)
+# include <sanitizer/asan_interface.h>
+# define DATA_POISON(ptr, len)   ASAN_POISON_MEMORY_REGION(ptr, len)
+# define DATA_UNPOISON(ptr, len) ASAN_UNPOISON_MEMORY_REGION(ptr, len)
+static enum StackPoisonMode globalPoisonMode = POISON_ASAN;
+#else
+# define DATA_POISON(ptr, len)   ((void) (ptr), (void) (len))
+# define DATA_UNPOISON(ptr, len) ((void) (ptr), (void) (len))
+static enum StackPoisonMode globalPoisonMode = POISON_LAZY;
+#endif
+
+static const uint64_t XOR_FILE_CONST = 0xEDABEDAF8A40FF15;
+
+const StackCapacityPolicy_t STACK_DEFAULT_POLICY      = {2.0, 4, 5, 0};
+const StackCapacityPolicy_t STACK_NEVER_SHRINK_POLICY = {2.0, 0, 5, 0};
+
+const StackDumpOptions_t STACK_DUMP_DEFAULT_OPTIONS = {16, 64, true, NULL};
+const StackDumpOptions_t STACK_DUMP_FULL_OPTIONS    = {SIZE_MAX, SIZE_MAX, false, NULL};
+static StackDumpOptions_t globalDumpOptions = STACK_DUMP_DEFAULT_OPTIONS;
+
+#ifndef NDEBUG
+static enum StackVerifyLevel globalVerifyLevel = VERIFY_FULL;
+#else
+static enum StackVerifyLevel globalVerifyLevel = VERIFY_OFF;
+#endif
+static size_t globalSamplePeriod = 64;
 
 /// @brief Stack change size supported operations
 enum StackSizeOp {
@@ -29,89 +59,288 @@ static size_t getCanaryAlign(size_t len);
 static size_t getSizeWithCanary(size_t len);
 )
 
-static void *smartRecalloc(void *data, size_t newLen, size_t oldLen, size_t elemSize) {
+/// Size of data block with canaries
+static size_t getBlockSize(size_t len) {
+    ON_CANARY(return getSizeWithCanary(len);)
+    return len;
+}
+
+// Allocation messages belong to memory subsystem
+#undef  LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM LOG_SUB_MEMORY
+
+/// Grown part is not initialized, stackPoisonTail decides what to do with it
+static void *smartRecalloc(const StackAllocator_t *allocator, void *data,
+                           size_t newLen, size_t oldLen, size_t elemSize) {
     logPrintWithTime(L_EXTRA, 0, "---------------------MEMORY LOG---------------------\n");
+    MY_ASSERT(allocator, abort());
 
     ON_CANARY(
-    size_t sizeDelta = 2 * sizeof(canary_t) + getCanaryAlign(newLen * elemSize);
     if (data != NULL)
         data = (char*) data - sizeof(canary_t);
     )
+    size_t oldBytes = getBlockSize(oldLen * elemSize);
+    size_t newBytes = getBlockSize(newLen * elemSize);
 
     if (newLen == 0) {
-        logPrint(L_EXTRA, 0, "FREE: %p\n", data);
-        free(data);
+        logPrint(L_EXTRA, 0, "FREE(%s): %p\n", allocator->name, data);
+        allocator->free(allocator->ctx, data, oldBytes);
     } else if (data == NULL) {
-        data = calloc(newLen * elemSize ON_CANARY(+ sizeDelta), 1);
-        logPrint(L_DEBUG, 0, "CALLOC: %p\n", data);
+        data = allocator->alloc(allocator->ctx, newBytes);
+        logPrint(L_DEBUG, 0, "ALLOC(%s): %p\n", allocator->name, data);
         logPrint(L_DEBUG, 0, "SIZE = %zu * %zu\n", newLen, elemSize);
     } else {
-        logPrint(L_DEBUG, 0, "REALLOC from: %p\n", data);
-        data = realloc(data, newLen * elemSize ON_CANARY(+ sizeDelta));
+        logPrint(L_DEBUG, 0, "REALLOC(%s) from: %p\n", allocator->name, data);
+        data = allocator->realloc(allocator->ctx, data, oldBytes, newBytes);
         logPrint(L_DEBUG, 0, "REALLOC   to: %p\n", data);
         logPrint(L_DEBUG, 0, "OLDSIZE = %zu * %zu\n", oldLen, elemSize);
         logPrint(L_DEBUG, 0, "NEWSIZE = %zu * %zu\n", newLen, elemSize);
 
     }
-
-    if (newLen > oldLen) {
-        char *fillStart = (char*) data ON_CANARY(+ sizeof(canary_t)) + elemSize * oldLen;
-        memValSet(fillStart, &POISON_ELEM, elemSize, newLen - oldLen);
-    }
+    MY_ASSERT(data || newLen == 0, abort());
 
     ON_CANARY(
     logPrint(L_DEBUG, 0, "WITH_CANARIES (bytes): %lu --> %lu\n",
                 getSizeWithCanary(oldLen * elemSize),
                 getSizeWithCanary(newLen * elemSize));
     if (newLen != 0)
-        fillCanaries(data, newLen * elemSize + sizeDelta);
+        fillCanaries(data, newBytes);
     data = (char*) data + sizeof(canary_t);
     )
     logPrintWithTime(L_DEBUG, 0, "-------------------------\n");
     return data;
 }
 
+#undef  LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM LOG_SUB_STACK
+
 ON_HASH(
-static uint64_t getDataHash(Stack_t *stk);
+static memChunkHash_t getDataHash(Stack_t *stk);
 static uint64_t getStackHash(Stack_t *stk);
+static void stackDataHashGrow(Stack_t *stk, size_t oldSize, size_t newSize);
+static void stackDataHashShrink(Stack_t *stk, size_t oldSize, size_t newSize);
+)
+
+ON_METRICS(
+static uint64_t metricsNowNs();
+static void metricsCountResize(Stack_t *stk, size_t newCapacity, size_t bytesCopied);
+static void metricsCountSize(Stack_t *stk);
+static void metricsCountHash(Stack_t *stk, uint64_t start);
+static void metricsCountVerify(Stack_t *stk, uint64_t start);
 )
 
+static void stackWriteBegin(Stack_t *stk);
+static void stackWriteEnd(Stack_t *stk);
+static void stackWaitScrubber(Stack_t *stk);
+static void stackRegistryAdd(Stack_t *stk);
+static void stackRegistryRemove(Stack_t *stk);
+
+/// Scrubber checks stacks it doesn't own, so it leaves their stats alone
+static thread_local bool isScrubberThread = false;
+
+static uint64_t getFileLayout();
+static uint64_t getFileHeaderHash(const StackFileHeader_t *header);
+static void stackStoreFileHeader(Stack_t *stk);
+static StackError_t stackAttachFile(Stack_t *stk);
+
 static StackError_t stackChangeSize(Stack_t *stk, enum StackSizeOp op);
+static StackError_t stackResize(Stack_t *stk, size_t newCapacity);
+static stkElem_t *stackInlineData(Stack_t *stk);
+static bool stackIsInline(Stack_t *stk);
+static bool stackFitsInline(Stack_t *stk, size_t capacity);
+static size_t stackGrownCapacity(Stack_t *stk, size_t needed);
+static size_t stackShrunkCapacity(Stack_t *stk, bool canShrink);
+static enum StackPoisonMode resolvePoisonMode(enum StackPoisonMode mode);
+static void stackPoisonTail(Stack_t *stk);
+static void stackUnpoisonTail(Stack_t *stk);
+static void stackPoisonSlots(Stack_t *stk, size_t from, size_t n);
+static void stackUnpoisonSlots(Stack_t *stk, size_t from, size_t n);
+
+/// POISON_ASAN without sanitizer is POISON_LAZY
+static enum StackPoisonMode resolvePoisonMode(enum StackPoisonMode mode) {
+#if !defined(__SANITIZE_ADDRESS__)
+    if (mode == POISON_ASAN)
+        return POISON_LAZY;
+#endif
+    return mode;
+}
+
+/// Bring [size, capacity) to state required by poison mode after data block has changed
+static void stackPoisonTail(Stack_t *stk) {
+    if (stk->highWater > stk->capacity)
+        stk->highWater = stk->capacity;
+    if (!stk->data)
+        return;
+
+    switch (stk->poisonMode) {
+        case POISON_EAGER:
+            // [size, highWater) is already poisoned
+            memValSet(stk->data + stk->highWater, &POISON_ELEM, sizeof(stkElem_t), stk->capacity - stk->highWater);
+            stk->highWater = stk->capacity;
+            break;
+        case POISON_ASAN:
+            stackWaitScrubber(stk);
+            DATA_POISON(stk->data + stk->size, (stk->capacity - stk->size) * sizeof(stkElem_t));
+            break;
+        case POISON_LAZY:
+        default:
+            break;
+    }
+}
+
+/// Make [size, capacity) addressable before allocator moves or frees data block
+static void stackUnpoisonTail(Stack_t *stk) {
+    if (stk->poisonMode == POISON_ASAN && stk->data)
+        DATA_UNPOISON(stk->data + stk->size, (stk->capacity - stk->size) * sizeof(stkElem_t));
+}
+
+/// Slots [from, from + n) have just been popped
+static void stackPoisonSlots(Stack_t *stk, size_t from, size_t n) {
+    if (stk->poisonMode == POISON_ASAN) {
+        // Sanitizer would report scrubber reading slot that is popped during its check
+        stackWaitScrubber(stk);
+        DATA_POISON(stk->data + from, n * sizeof(stkElem_t));
+    } else
+        memValSet(stk->data + from, &POISON_ELEM, sizeof(stkElem_t), n);
+}
+
+/// Slots [from, from + n) are going to be pushed
+static void stackUnpoisonSlots(Stack_t *stk, size_t from, size_t n) {
+    if (stk->poisonMode == POISON_ASAN)
+        DATA_UNPOISON(stk->data + from, n * sizeof(stkElem_t));
+    if (from + n > stk->highWater)
+        stk->highWater = from + n;
+}
+
+/// Capacity to hold at least needed elements according to policy
+static size_t stackGrownCapacity(Stack_t *stk, size_t needed) {
+    const StackCapacityPolicy_t *policy = &stk->policy;
+    size_t newCapacity = (size_t) ((double) stk->capacity * policy->growFactor);
+    if (newCapacity <= stk->capacity)
+        newCapacity = stk->capacity + 1;
+    if (newCapacity < policy->minCapacity)
+        newCapacity = policy->minCapacity;
+    if (newCapacity < needed)
+        newCapacity = needed;
+    return newCapacity;
+}
+
+/// Count underused operations, return capacity after shrink (current one if stack shouldn't shrink)
+static size_t stackShrunkCapacity(Stack_t *stk, bool canShrink) {
+    const StackCapacityPolicy_t *policy = &stk->policy;
+    // Inline block can't shrink
+    if (policy->shrinkRatio == 0 || stackIsInline(stk))
+        return stk->capacity;
+
+    size_t newCapacity = stk->capacity;
+    while (newCapacity / 2 >= policy->minCapacity && policy->shrinkRatio * stk->size < newCapacity)
+        newCapacity /= 2;
+
+    if (newCapacity == stk->capacity) {
+        stk->underusedOps = 0;
+        return stk->capacity;
+    }
+    if (++stk->underusedOps <= policy->shrinkDelay || !canShrink)
+        return stk->capacity;
+
+    stk->underusedOps = 0;
+    return newCapacity;
+}
+
+/// Elements of inline data block, NULL if small-buffer optimization is disabled
+static stkElem_t *stackInlineData(Stack_t *stk) {
+#if STACK_INLINE_CAPACITY > 0
+    return (stkElem_t *) ((char *) stk->inlineBlock ON_CANARY(+ sizeof(canary_t)));
+#else
+    (void) stk;
+    return NULL;
+#endif
+}
+
+static bool stackIsInline(Stack_t *stk) {
+    return stk->data && stk->data == stackInlineData(stk);
+}
+
+/// Mapped stacks keep data in file
+static bool stackFitsInline(Stack_t *stk, size_t capacity) {
+    return STACK_INLINE_CAPACITY > 0 && !stk->fileMap && capacity > 0 && capacity <= STACK_INLINE_CAPACITY;
+}
+
+static StackError_t stackResize(Stack_t *stk, size_t newCapacity) {
+    MY_ASSERT(stk, abort());
+    MY_ASSERT(newCapacity >= stk->size, abort());
+    stkElem_t *inlineData = stackInlineData(stk);
+    bool wasInline = stackIsInline(stk);
+    bool toInline  = stackFitsInline(stk, newCapacity);
+    if (toInline)
+        newCapacity = STACK_INLINE_CAPACITY;
+    if (wasInline && toInline)
+        return STACK_OK;
+
+    logPrintWithTime(L_DEBUG, 0, "Reallocating stack[%p] data: %lu --> %lu%s\n", stk, stk->capacity, newCapacity,
+                     (toInline) ? " (inline)" : "");
+    ON_METRICS(uintptr_t oldAddress = (uintptr_t) stk->data;)
+    ON_METRICS(size_t bytesCopied = 0;)
+    // Scrubber may be reading block that is going to be freed
+    stackWaitScrubber(stk);
+    stackUnpoisonTail(stk);
+    if (toInline || wasInline) {
+        // Block moves between Stack_t and allocator: only elements are copied, slots above are new
+        stkElem_t *newData = inlineData;
+        if (toInline) {
+            ON_CANARY(fillCanaries((char *) inlineData - sizeof(canary_t), getBlockSize(newCapacity * sizeof(stkElem_t)));)
+        } else if (newCapacity)
+            newData = (stkElem_t *) smartRecalloc(stk->allocator, NULL, newCapacity, 0, sizeof(stkElem_t));
+        else
+            newData = NULL;
+        if (stk->size)
+            memcpy(newData, stk->data, stk->size * sizeof(stkElem_t));
+        ON_METRICS(bytesCopied = stk->size * sizeof(stkElem_t);)
+        if (!wasInline && stk->data)
+            smartRecalloc(stk->allocator, stk->data, 0, stk->capacity, sizeof(stkElem_t));
+        stk->data = newData;
+        stk->highWater = stk->size;
+    } else if (newCapacity == 0) {
+        smartRecalloc(stk->allocator, stk->data, 0, stk->capacity, sizeof(stkElem_t));
+        stk->data = NULL;
+    } else {
+        stk->data = (stkElem_t*) smartRecalloc(stk->allocator, stk->data, newCapacity, stk->capacity, sizeof(stkElem_t));
+        // Realloc copies whole old block only when it can't be resized in place
+        ON_METRICS(
+        if (oldAddress && (uintptr_t) stk->data != oldAddress)
+            bytesCopied = ((newCapacity < stk->capacity) ? newCapacity : stk->capacity) * sizeof(stkElem_t);
+        )
+    }
+    ON_METRICS(metricsCountResize(stk, newCapacity, bytesCopied);)
+    stk->capacity = newCapacity;
+    stackPoisonTail(stk);
+    return STACK_OK;
+}
 
 static StackError_t stackChangeSize(Stack_t *stk, enum StackSizeOp op) {
     MY_ASSERT(stk, abort());
     MY_ASSERT(int(op) == 1 || int(op) == -1, abort());
     MY_ASSERT(!(int(op) == -1 && stk->size == 0), abort());
-    STACK_ASSERT(stk);
     logPrintWithTime(L_EXTRA, 0, "Stack_t[%p] size change %d: %lu -> %lu\n", stk, op, stk->size, stk->size + int(op));
 
-    bool needsRealloc = false;
-    size_t newCapacity = 0;
-    if        (op == OP_PUSH && stk->size >= stk->capacity) {
-        needsRealloc = true;
-        newCapacity = ((2 * stk->capacity) > ALLOC_MIN_SIZE) ? (2*stk->capacity) : ALLOC_MIN_SIZE;
-    } else if (op == OP_POP  && stk->size > DEALLOC_MIN_SIZE && (4 * stk->size) < stk->capacity) {
-        needsRealloc = true;
-        newCapacity = stk->capacity / 2;
-    }
-
-    if (needsRealloc) {
-        logPrintWithTime(L_DEBUG, 0, "Reallocating stack[%p] data: %lu --> %lu\n", stk, stk->capacity, newCapacity);
-        stk->data = (stkElem_t*) smartRecalloc(stk->data, newCapacity, stk->capacity, sizeof(stkElem_t));
-        stk->capacity = newCapacity;
-    }
+    if (op == OP_PUSH && stk->size >= stk->capacity)
+        stackResize(stk, stackGrownCapacity(stk, stk->size + 1));
 
+    // Hashes are not updated here: caller changes element and updates them once
+    if (op == OP_PUSH) stackUnpoisonSlots(stk, stk->size, 1);
     stk->size += int(op);
-    if (op == OP_POP) memcpy(stk->data + stk->size, &POISON_ELEM, sizeof(stkElem_t));
-    ON_HASH(
-    stk->dataHash  = getDataHash(stk);
-    stk->stackHash = getStackHash(stk);
-    )
-    STACK_ASSERT(stk);
+    if (op == OP_POP)  stackPoisonSlots(stk, stk->size, 1);
+    if (stk->size < stk->lowWater)
+        stk->lowWater = stk->size;
+
+    // Shrink only on pop, but every operation on underused stack counts for shrinkDelay
+    size_t newCapacity = stackShrunkCapacity(stk, op == OP_POP);
+    if (newCapacity != stk->capacity)
+        stackResize(stk, newCapacity);
     return 0;
 }
 
-StackError_t stackCtorBase(Stack_t *stk, size_t startCapacity
+StackError_t stackCtorBase(Stack_t *stk, size_t startCapacity, const StackAllocator_t *allocator
                 ON_DEBUG(, const char *initFile, int initLine, const char *name)) {
     MY_ASSERT(stk, {
         ON_DEBUG(logPrint(L_ZERO, 1, "\"%s\" at %s:%d\n", name, initFile, initLine);)
@@ -137,6 +366,9 @@ StackError_t stackCtorBase(Stack_t *stk, size_t startCapacity
     )
 
     stk->size = 0;
+    stk->allocator = allocator ? allocator : stackGetDefaultAllocator();
+    stk->policy = STACK_DEFAULT_POLICY;
+    stk->poisonMode = resolvePoisonMode(globalPoisonMode);
 
     MY_ASSERT(startCapacity < MAX_STACK_SIZE, {
         ON_DEBUG(
@@ -146,23 +378,176 @@ StackError_t stackCtorBase(Stack_t *stk, size_t startCapacity
         abort();
     });
 
-    stk->capacity = startCapacity;
-    stk->data = (startCapacity == 0) ?
-                NULL :
-                (stkElem_t *) smartRecalloc(NULL, startCapacity, 0, sizeof(stkElem_t));
+    if (startCapacity != 0)
+        stackResize(stk, startCapacity);
 
     ON_HASH(
     stk->dataHash  = getDataHash(stk);
     stk->stackHash = getStackHash(stk);
     )
     STACK_ASSERT(stk);
+    stackRegistryAdd(stk);
 
     return 0;
 }
 
+StackError_t stackCtorMappedBase(Stack_t *stk, const char *path
+                ON_DEBUG(, const char *initFile, int initLine, const char *name)) {
+    MY_ASSERT(stk && path, abort());
+    StackFileMap_t *map = stackFileMapOpen(path);
+    if (!map)
+        return ERR_FILE;
+
+    // Empty stack with file allocator, then block stored in file is attached to it
+    stackCtorBase(stk, 0, &map->allocator ON_DEBUG(, initFile, initLine, name));
+    stackWriteBegin(stk);
+    stk->fileMap = map;
+
+    const StackFileHeader_t *header = (const StackFileHeader_t *) map->base;
+    if (header->magic == 0 && map->blockBytes == 0)
+        logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] created new stack file %s\n", stk, path);
+    else {
+        StackError_t err = stackAttachFile(stk);
+        if (err) {
+            logPrintWithTime(L_ZERO, 1, "Stack file %s is broken: %s\n", path, stackFirstErrorToStr(err));
+            stackRegistryRemove(stk);
+            memset(stk, 0, sizeof(*stk));
+            stackFileMapClose(map);
+            return err;
+        }
+        logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] opened stack file %s: %zu elements\n", stk, path, stk->size);
+    }
+
+    stackStoreFileHeader(stk);
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+/// Check header and data block of mapped file and make them stack contents
+static StackError_t stackAttachFile(Stack_t *stk) {
+    StackFileMap_t *map = stk->fileMap;
+    const StackFileHeader_t *header = (const StackFileHeader_t *) map->base;
+    StackError_t err = STACK_OK;
+
+    if (header->magic != STACK_FILE_MAGIC || header->layout != getFileLayout())
+        return ERR_FILE;
+    if (header->goose1 != (STACK_FILE_MAGIC ^ XOR_FILE_CONST))
+        err |= ERR_CANARY_LEFT;
+    if (header->goose2 != (STACK_FILE_MAGIC ^ XOR_FILE_CONST))
+        err |= ERR_CANARY_RIGHT;
+    if (header->headerHash != getFileHeaderHash(header))
+        err |= ERR_HASH_STACK;
+    if (header->size > header->capacity)
+        err |= ERR_LOGIC;
+    if (header->capacity > MAX_STACK_SIZE || getBlockSize(header->capacity * sizeof(stkElem_t)) != map->blockBytes)
+        err |= ERR_CAPACITY;
+    if (err)
+        return err;
+
+    char *block = (header->capacity) ? map->base + STACK_FILE_HEADER_BYTES : NULL;
+    ON_CANARY(
+    if (block) {
+        // Canaries were written for address of previous mapping
+        ullPair_t canaries = getCanaries(block, map->blockBytes);
+        if (!canaryOk(canaries.first,  (void *) header->blockAddress))
+            err |= ERR_DATA_CANARY_LEFT;
+        if (!canaryOk(canaries.second, (void *) header->blockAddress))
+            err |= ERR_DATA_CANARY_RIGHT;
+        if (err)
+            return err;
+        fillCanaries(block, map->blockBytes);
+        block += sizeof(canary_t);
+    }
+    )
+    stk->data      = (stkElem_t *) block;
+    stk->capacity  = header->capacity;
+    stk->size      = header->size;
+    stk->highWater = stk->size;     // nothing is known about slots above size
+    ON_METRICS(metricsCountSize(stk);)
+    ON_HASH(
+    stk->dataHash = header->dataHash;
+    // Release builds (VERIFY_OFF) open file in O(1)
+    if (globalVerifyLevel != VERIFY_OFF && !memChunkHashEqual(stk->dataHash, getDataHash(stk)))
+        return ERR_HASH_DATA;
+    )
+    stackPoisonTail(stk);
+    return STACK_OK;
+}
+
+/// Element size, protections and hash backend must be the same in writer and reader
+static uint64_t getFileLayout() {
+    uint64_t layout = sizeof(stkElem_t);
+    ON_CANARY(layout |= 1ull << 32;)
+    ON_HASH(layout |= 1ull << 33;)
+    return layout | (uint64_t) getMemHashBackend() << 40;
+}
+
+static uint64_t getFileHeaderHash(const StackFileHeader_t *header) {
+    StackFileHeader_t copy = *header;
+    copy.headerHash = 0;
+    return memHash(&copy, sizeof(copy));
+}
+
+/// Write stack state to header of its file
+static void stackStoreFileHeader(Stack_t *stk) {
+    StackFileHeader_t *header = (StackFileHeader_t *) stk->fileMap->base;
+    header->magic    = STACK_FILE_MAGIC;
+    header->goose1   = header->goose2 = STACK_FILE_MAGIC ^ XOR_FILE_CONST;
+    header->layout   = getFileLayout();
+    header->size     = stk->size;
+    header->capacity = stk->capacity;
+    header->blockAddress = (stk->data) ? (uint64_t) stk->data ON_CANARY(- sizeof(canary_t)) : 0;
+    ON_HASH(
+    header->dataHash = stk->dataHash;
+    )
+    header->headerHash = getFileHeaderHash(header);
+}
+
+StackError_t stackCloseMapped(Stack_t *stk) {
+    STACK_ASSERT(stk);
+    MY_ASSERT(stk->fileMap, abort());
+    stackRegistryRemove(stk);
+    stackStoreFileHeader(stk);
+    stackUnpoisonTail(stk);
+    stackFileMapClose(stk->fileMap);
+    memset(stk, 0, sizeof(*stk));
+    return STACK_OK;
+}
+
+StackError_t stackSyncMapped(Stack_t *stk) {
+    STACK_ASSERT(stk);
+    MY_ASSERT(stk->fileMap, abort());
+    return (stackFileMapSync(stk->fileMap) == 0) ? STACK_OK : ERR_FILE;
+}
+
+StackError_t stackMarkCheckpoint(Stack_t *stk, uint64_t tag) {
+    STACK_ASSERT(stk);
+    stackWriteBegin(stk);
+    stk->lowWater = stk->size;
+    stk->checkpointTag = tag;
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
 StackError_t stackDtor(Stack_t *stk) {
     STACK_ASSERT(stk);
-    smartRecalloc(stk->data, 0, stk->capacity, sizeof(stkElem_t));
+    stackRegistryRemove(stk);
+    stackUnpoisonTail(stk);
+    if (!stackIsInline(stk))
+        smartRecalloc(stk->allocator, stk->data, 0, stk->capacity, sizeof(stkElem_t));
+    if (stk->fileMap) {
+        // File without header is opened as new stack
+        memset(stk->fileMap->base, 0, sizeof(StackFileHeader_t));
+        stackFileMapClose(stk->fileMap);
+    }
     memset(stk, 0, sizeof(*stk));
     return STACK_OK;
 }
@@ -172,14 +557,20 @@ StackError_t stackPushBase(Stack_t *stk, stkElem_t val
     STACK_VERBOSE_ASSERT(stk);
 
     logPrintWithTime(L_EXTRA, 0, "Stack_t[%p] push: " STK_ELEM_FMT "\n", stk, val);
+    stackWriteBegin(stk);
     stackChangeSize(stk, OP_PUSH);
 
     stk->data[stk->size-1] = val;
+    ON_METRICS(stk->stats.pushes++;)
+    ON_METRICS(metricsCountSize(stk);)
 
     ON_HASH(
-    stk->dataHash  = getDataHash(stk);
+    stackDataHashGrow(stk, stk->size - 1, stk->size);
     stk->stackHash = getStackHash(stk);
     )
+    if (stk->fileMap)
+        stackStoreFileHeader(stk);
+    stackWriteEnd(stk);
 
     STACK_VERBOSE_ASSERT(stk);
     return 0;
@@ -192,17 +583,150 @@ stkElem_t stackPopBase(Stack_t *stk ON_DEBUG(, const char *FILE_, int LINE_, con
     logPrintWithTime(L_EXTRA, 0, "Stack_t[%p] pop: size = %lu, val = " STK_ELEM_FMT "\n",stk, stk->size, stk->data[stk->size-1]);
 
     stkElem_t val = stk->data[stk->size - 1];
+    stackWriteBegin(stk);
+    ON_METRICS(stk->stats.pops++;)
+    ON_HASH(
+    stackDataHashShrink(stk, stk->size, stk->size - 1);
+    )
 
     stackChangeSize(stk, OP_POP);
     ON_HASH(
-    stk->dataHash  = getDataHash(stk);
     stk->stackHash = getStackHash(stk);
     )
+    if (stk->fileMap)
+        stackStoreFileHeader(stk);
+    stackWriteEnd(stk);
 
     STACK_VERBOSE_ASSERT(stk);
     return val;
 }
 
+StackError_t stackShrinkToFit(Stack_t *stk) {
+    STACK_ASSERT(stk);
+    if (stk->capacity == stk->size)
+        return STACK_OK;
+
+    stackWriteBegin(stk);
+    stackResize(stk, stk->size);
+    stk->underusedOps = 0;
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    if (stk->fileMap)
+        stackStoreFileHeader(stk);
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+StackError_t stackSetCapacityPolicy(Stack_t *stk, const StackCapacityPolicy_t *policy) {
+    STACK_ASSERT(stk);
+    MY_ASSERT(policy, abort());
+    MY_ASSERT(policy->growFactor > 1, abort());
+    logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] capacity policy: grow x%g, shrink 1/%zu, min %zu, delay %zu\n",
+                     stk, policy->growFactor, policy->shrinkRatio, policy->minCapacity, policy->shrinkDelay);
+    stackWriteBegin(stk);
+    stk->policy = *policy;
+    stk->underusedOps = 0;
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+StackError_t stackReserve(Stack_t *stk, size_t capacity) {
+    STACK_ASSERT(stk);
+    MY_ASSERT(capacity < MAX_STACK_SIZE, abort());
+    if (capacity <= stk->capacity)
+        return STACK_OK;
+
+    stackWriteBegin(stk);
+    stackResize(stk, capacity);
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    if (stk->fileMap)
+        stackStoreFileHeader(stk);
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+StackError_t stackPushNBase(Stack_t *stk, const stkElem_t *src, size_t n
+                ON_DEBUG(, const char *FILE_, int LINE_, const char *NAME_)) {
+    STACK_VERBOSE_ASSERT(stk);
+    MY_ASSERT(src || n == 0, abort());
+    MY_ASSERT(stk->size + n < MAX_STACK_SIZE, abort());
+    if (n == 0)
+        return STACK_OK;
+
+    logPrintWithTime(L_EXTRA, 0, "Stack_t[%p] push %lu elements: %lu -> %lu\n", stk, n, stk->size, stk->size + n);
+    // src may point at elements of stk itself: they move with data block on resize
+    bool inside = src >= stk->data && src < stk->data + stk->size;
+    size_t offset = inside ? (size_t) (src - stk->data) : 0;
+    MY_ASSERT(!inside || offset + n <= stk->size, abort());
+    stackWriteBegin(stk);
+    if (stk->size + n > stk->capacity)
+        stackResize(stk, stackGrownCapacity(stk, stk->size + n));
+    if (inside)
+        src = stk->data + offset;
+
+    stackUnpoisonSlots(stk, stk->size, n);
+    memcpy(stk->data + stk->size, src, n * sizeof(stkElem_t));
+    ON_HASH(
+    stackDataHashGrow(stk, stk->size, stk->size + n);
+    )
+    stk->size += n;
+    ON_METRICS(stk->stats.pushes += n;)
+    ON_METRICS(metricsCountSize(stk);)
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    if (stk->fileMap)
+        stackStoreFileHeader(stk);
+    stackWriteEnd(stk);
+
+    STACK_VERBOSE_ASSERT(stk);
+    return STACK_OK;
+}
+
+StackError_t stackPopNBase(Stack_t *stk, stkElem_t *out, size_t n
+                ON_DEBUG(, const char *FILE_, int LINE_, const char *NAME_)) {
+    STACK_VERBOSE_ASSERT(stk);
+    MY_ASSERT((stk->size >= n), abort());
+    if (n == 0)
+        return STACK_OK;
+
+    logPrintWithTime(L_EXTRA, 0, "Stack_t[%p] pop %lu elements: %lu -> %lu\n", stk, n, stk->size, stk->size - n);
+    stackWriteBegin(stk);
+    ON_HASH(
+    stackDataHashShrink(stk, stk->size, stk->size - n);
+    )
+    stk->size -= n;
+    ON_METRICS(stk->stats.pops += n;)
+    if (stk->size < stk->lowWater)
+        stk->lowWater = stk->size;
+    if (out)
+        memcpy(out, stk->data + stk->size, n * sizeof(stkElem_t));
+    stackPoisonSlots(stk, stk->size, n);
+
+    size_t newCapacity = stackShrunkCapacity(stk, true);
+    if (newCapacity != stk->capacity)
+        stackResize(stk, newCapacity);
+
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    if (stk->fileMap)
+        stackStoreFileHeader(stk);
+    stackWriteEnd(stk);
+
+    STACK_VERBOSE_ASSERT(stk);
+    return STACK_OK;
+}
+
 stkElem_t stackTop(Stack_t *stk) {
     STACK_ASSERT(stk);
     MY_ASSERT((stk->size > 0), abort());
@@ -215,12 +739,114 @@ size_t stackGetSize(Stack_t *stk) {
     return stk->size;
 }
 
+StackStats_t stackGetStats(Stack_t *stk) {
+    STACK_ASSERT(stk);
+    StackStats_t stats = {};
+    ON_METRICS(stats = stk->stats;)
+    return stats;
+}
+
+StackError_t stackResetStats(Stack_t *stk) {
+    STACK_ASSERT(stk);
+    ON_METRICS(
+    memset(&stk->stats, 0, sizeof(stk->stats));
+    stk->stats.peakSize = stk->size;
+    )
+    return STACK_OK;
+}
+
+static StackError_t stackVerifyBase(Stack_t *stk, bool checkHashes);
+static StackError_t stackVerifyChecks(Stack_t *stk, bool checkHashes);
+
 StackError_t stackVerify(Stack_t *stk) {
-    StackError_t err = STACK_OK;
+    return stackVerifyBase(stk, true);
+}
+
+StackError_t stackCheck(Stack_t *stk) {
     if (stk == NULL)
-        return (err = ERR_NULLPTR);
+        return ERR_NULLPTR;
+
+    enum StackVerifyLevel level = (stk->verifyLevel == VERIFY_DEFAULT) ? globalVerifyLevel : stk->verifyLevel;
+    switch (level) {
+        case VERIFY_OFF:
+            return STACK_OK;
+        case VERIFY_CANARY:
+            return stackVerifyBase(stk, false);
+        case VERIFY_SAMPLED: {
+            size_t period = stk->samplePeriod ? stk->samplePeriod : globalSamplePeriod;
+            // State after every period-th change is checked fully, by entry and exit checks alike
+            return stackVerifyBase(stk, (stk->opCounter % period) == 0);
+        }
+        case VERIFY_DEFAULT:
+        case VERIFY_FULL:
+        default:
+            return stackVerifyBase(stk, true);
+    }
+}
+
+void stackSetDefaultPoisonMode(enum StackPoisonMode mode) {
+    globalPoisonMode = mode;
+}
+
+StackError_t stackSetPoisonMode(Stack_t *stk, enum StackPoisonMode mode) {
+    STACK_ASSERT(stk);
+    mode = resolvePoisonMode(mode);
+    logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] poison mode: %d -> %d\n", stk, stk->poisonMode, mode);
+
+    stackWriteBegin(stk);
+    stackUnpoisonTail(stk);
+    // Contents of sanitizer-poisoned slots are unknown
+    if (stk->poisonMode == POISON_ASAN)
+        stk->highWater = stk->size;
+    stk->poisonMode = mode;
+    stackPoisonTail(stk);
+
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+void stackSetGlobalVerifyLevel(enum StackVerifyLevel level, size_t samplePeriod) {
+    MY_ASSERT(level != VERIFY_DEFAULT, return);
+    globalVerifyLevel = level;
+    if (samplePeriod)
+        globalSamplePeriod = samplePeriod;
+}
+
+StackError_t stackSetVerifyLevel(Stack_t *stk, enum StackVerifyLevel level, size_t samplePeriod) {
+    STACK_ASSERT(stk);
+    logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] verify level: %d -> %d\n", stk, stk->verifyLevel, level);
+    stackWriteBegin(stk);
+    stk->verifyLevel  = level;
+    stk->samplePeriod = samplePeriod;
+    stk->opCounter    = 0;
+    ON_HASH(
+    stk->stackHash = getStackHash(stk);
+    )
+    stackWriteEnd(stk);
+    STACK_ASSERT(stk);
+    return STACK_OK;
+}
 
-    if (stk->size > stk->capacity)
+/// Checks are timed in stats of stack, they are not covered by stackHash
+static StackError_t stackVerifyBase(Stack_t *stk, bool checkHashes) {
+    if (stk == NULL)
+        return ERR_NULLPTR;
+    ON_METRICS(uint64_t start = metricsNowNs();)
+    StackError_t err = stackVerifyChecks(stk, checkHashes);
+    ON_METRICS(metricsCountVerify(stk, start);)
+    return err;
+}
+
+/// checkHashes = false leaves only O(1) checks: sizes, pointers and canaries
+static StackError_t stackVerifyChecks(Stack_t *stk, bool checkHashes) {
+    (void) checkHashes;
+    StackError_t err = STACK_OK;
+
+    if (stk->size > stk->capacity || stk->highWater > stk->capacity || stk->lowWater > stk->size)
         err |= ERR_LOGIC;
     if (stk->size > MAX_STACK_SIZE)
         err |= ERR_SIZE;
@@ -231,10 +857,10 @@ StackError_t stackVerify(Stack_t *stk) {
         err |= ERR_DATA;
 
     ON_HASH(
-    if (stk->stackHash != getStackHash(stk))
+    if (checkHashes && stk->stackHash != getStackHash(stk))
         err |= ERR_HASH_STACK;
-    // Calculate data hash if there's no ERR_DATA and no ERR_HASH_STACK
-    if (!(err & (ERR_DATA + ERR_HASH_STACK)) && (stk->dataHash != getDataHash(stk)))
+    // Calculate data hash if there's no ERR_DATA, ERR_LOGIC, ERR_SIZE and no ERR_HASH_STACK
+    if (checkHashes && !(err & (ERR_DATA + ERR_LOGIC + ERR_SIZE + ERR_HASH_STACK)) && !memChunkHashEqual(stk->dataHash, getDataHash(stk)))
         err |= ERR_HASH_DATA;
     )
     ON_CANARY(
@@ -251,7 +877,24 @@ StackError_t stackVerify(Stack_t *stk) {
     return err;
 }
 
-static bool stackDumpData(Stack_t *stk, StackError_t stkError);
+/// @brief Text of dump elements, written to log in big pieces instead of line by line
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} dumpBuffer_t;
+
+static const size_t DUMP_BUFFER_START = 1 << 12;
+static const size_t DUMP_FLUSH_BYTES  = 1 << 20;
+
+static void dumpPrintf(dumpBuffer_t *buf, const char *fmt, ...) __attribute__( (format( printf, 2, 3 ) ) );
+static void dumpFlush(dumpBuffer_t *buf);
+static void dumpElems(dumpBuffer_t *buf, const stkElem_t *data, size_t from, size_t to, char marker, bool collapse);
+static bool dumpSameRun(const stkElem_t *data, size_t index, bool collapse);
+static void dumpRange(dumpBuffer_t *buf, const stkElem_t *data, size_t from, size_t to, char marker,
+                      const StackDumpOptions_t *options);
+static void dumpRawFile(dumpBuffer_t *buf, const stkElem_t *data, size_t size, const char *path);
+static bool stackDumpData(Stack_t *stk, StackError_t stkError, const StackDumpOptions_t *options);
 static bool stackDumpErr (StackError_t err);
 
 static bool stackDumpErr(StackError_t err) {
@@ -280,8 +923,95 @@ static bool stackDumpErr(StackError_t err) {
     return true;
 }
 
-static bool stackDumpData(Stack_t *stk, StackError_t stkError) {
-    logPrint(L_ZERO, 0, "\tdata[%p] {\n", stk->data);
+static void dumpPrintf(dumpBuffer_t *buf, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf->data + buf->size, buf->capacity - buf->size, fmt, args);
+    va_end(args);
+    if (len < 0)
+        return;
+    if (buf->size + (size_t) len >= buf->capacity) {
+        size_t newCapacity = 2 * buf->capacity;
+        while (buf->size + (size_t) len >= newCapacity)
+            newCapacity *= 2;
+        char *newData = (char *) realloc(buf->data, newCapacity);
+        MY_ASSERT(newData, abort());
+        buf->data = newData;
+        buf->capacity = newCapacity;
+        va_start(args, fmt);
+        vsnprintf(buf->data + buf->size, buf->capacity - buf->size, fmt, args);
+        va_end(args);
+    }
+    buf->size += (size_t) len;
+    if (buf->size >= DUMP_FLUSH_BYTES)
+        dumpFlush(buf);
+}
+
+static void dumpFlush(dumpBuffer_t *buf) {
+    if (buf->size)
+        logPrint(L_ZERO, 0, "%s", buf->data);
+    buf->size = 0;
+    buf->data[0] = '\0';
+}
+
+/// Runs of POISON_ELEM are always collapsed, runs of other values if collapse is set
+static void dumpElems(dumpBuffer_t *buf, const stkElem_t *data, size_t from, size_t to, char marker, bool collapse) {
+    for (size_t index = from; index < to; ) {
+        bool poison = memcmp(data + index, &POISON_ELEM, sizeof(stkElem_t)) == 0;
+        size_t end = index + 1;
+        if (collapse || poison)
+            while (end < to && memcmp(data + end, data + index, sizeof(stkElem_t)) == 0)
+                end++;
+
+        if (end - index == 1)
+            dumpPrintf(buf, "\t%c [%3zu] " STK_ELEM_FMT "%s\n", marker, index, data[index],
+                       (poison) ? " (POISON)" : "");
+        else
+            dumpPrintf(buf, "\t%c [%3zu..%3zu] " STK_ELEM_FMT "%s (x%zu)\n", marker, index, end - 1, data[index],
+                       (poison) ? " (POISON)" : "", end - index);
+        index = end;
+    }
+}
+
+/// Elements index-1 and index are printed as one line
+static bool dumpSameRun(const stkElem_t *data, size_t index, bool collapse) {
+    return memcmp(data + index - 1, data + index, sizeof(stkElem_t)) == 0 &&
+           (collapse || memcmp(data + index, &POISON_ELEM, sizeof(stkElem_t)) == 0);
+}
+
+/// Only bottomElems and topElems of [from, to) are printed, runs crossing these borders are printed whole
+static void dumpRange(dumpBuffer_t *buf, const stkElem_t *data, size_t from, size_t to, char marker,
+                      const StackDumpOptions_t *options) {
+    size_t count = to - from;
+    size_t bottomEnd = from + ((count < options->bottomElems) ? count : options->bottomElems);
+    size_t topStart  = (to - bottomEnd > options->topElems) ? to - options->topElems : bottomEnd;
+    while (bottomEnd > from && bottomEnd < topStart && dumpSameRun(data, bottomEnd, options->collapseRuns))
+        bottomEnd++;
+    while (topStart < to && topStart > bottomEnd && dumpSameRun(data, topStart, options->collapseRuns))
+        topStart--;
+    if (bottomEnd == topStart) {
+        dumpElems(buf, data, from, to, marker, options->collapseRuns);
+        return;
+    }
+    dumpElems(buf, data, from, bottomEnd, marker, options->collapseRuns);
+    dumpPrintf(buf, "\t%c [%3zu..%3zu] ... %zu elements skipped ...\n", marker,
+               bottomEnd, topStart - 1, topStart - bottomEnd);
+    dumpElems(buf, data, topStart, to, marker, options->collapseRuns);
+}
+
+static void dumpRawFile(dumpBuffer_t *buf, const stkElem_t *data, size_t size, const char *path) {
+    FILE *raw = fopen(path, "wb");
+    if (!raw) {
+        dumpPrintf(buf, "\t  raw file %s can't be opened\n", path);
+        return;
+    }
+    size_t written = fwrite(data, sizeof(stkElem_t), size, raw);
+    fclose(raw);
+    dumpPrintf(buf, "\t  raw file %s: %zu of %zu elements, %zu bytes each\n", path, written, size, sizeof(stkElem_t));
+}
+
+static bool stackDumpData(Stack_t *stk, StackError_t stkError, const StackDumpOptions_t *options) {
+    logPrint(L_ZERO, 0, "\tdata[%p]%s {\n", stk->data, (stackIsInline(stk)) ? " (inline)" : "");
     if (!stk->data) {
         logPrint(L_ZERO, 0, "\t}\n");
         return true;
@@ -298,56 +1028,50 @@ static bool stackDumpData(Stack_t *stk, StackError_t stkError) {
         return true;
     }
 
+    dumpBuffer_t buf = {(char *) calloc(DUMP_BUFFER_START, 1), 0, DUMP_BUFFER_START};
+    MY_ASSERT(buf.data, abort());
+
     ON_CANARY(
     ullPair_t canaries = getCanaries((char*)stk->data - sizeof(canary_t),
                                         getSizeWithCanary(stk->capacity * sizeof(stkElem_t)));
-    logPrint(L_ZERO, 0, "\t^ [ -1] %zX (DataCanary1)\n", canaries.first);
+    dumpPrintf(&buf, "\t^ [ -1] %zX (DataCanary1)\n", canaries.first);
     if (stkError & ERR_DATA_CANARY_LEFT)
-        logPrint(L_ZERO, 0, "BROKEN:     %zX is correct canary\n", ((size_t)stk->data - sizeof(canary_t)) ^ XOR_CONST);                                                                                                                  \
-    logPrint(L_ZERO, 0, "\t^ [%3d] %zX (DataCanary2)\n", stk->capacity, canaries.second);
+        dumpPrintf(&buf, "BROKEN:     %zX is correct canary\n", ((size_t)stk->data - sizeof(canary_t)) ^ XOR_CONST);
+    dumpPrintf(&buf, "\t^ [%3zu] %zX (DataCanary2)\n", stk->capacity, canaries.second);
     if (stkError & ERR_DATA_CANARY_RIGHT)
-        logPrint(L_ZERO, 0, "BROKEN:     %zX is correct canary\n", ((size_t)stk->data - sizeof(canary_t)) ^ XOR_CONST);
+        dumpPrintf(&buf, "BROKEN:     %zX is correct canary\n", ((size_t)stk->data - sizeof(canary_t)) ^ XOR_CONST);
     )
 
-    for (size_t index = 0; index < stk->size && index < stk->capacity; index++) {
-        logPrint(L_ZERO, 0, "\t* ");
-        if (memcmp(stk->data + index, &POISON_ELEM, sizeof(stkElem_t)) == 0)
-            logPrint(L_ZERO, 0, "[%3d] %zX (POISON)\n", index, POISON_ELEM);
-        else
-            logPrint(L_ZERO, 0, "[%3d] " STK_ELEM_FMT "\n", index, stk->data[index]);
-    }
+    size_t size = (stk->size < stk->capacity) ? stk->size : stk->capacity;
+    dumpRange(&buf, stk->data, 0, size, '*', options);
+    if (options->rawPath)
+        dumpRawFile(&buf, stk->data, size, options->rawPath);
 
-    // 0 -> no poison elements
-    // 1 -> encountered poison element
-    // 2 -> poison elements are repeating; don't print them
-    int poisonElems = 0;
-    for (size_t index = stk->size; index < stk->capacity; index++) {
-        if (memcmp(stk->data + index, &POISON_ELEM, sizeof(POISON_ELEM)) == 0) {
-            if (poisonElems == 0) {
-                poisonElems = 1;
-                logPrint(L_ZERO, 0, "\t  [%3d] %zX (POISON)\n", index, POISON_ELEM);
-            } else if (poisonElems == 1) {
-                logPrint(L_ZERO, 0, "\t  [|||] %zX (POISON)\n", POISON_ELEM);
-                poisonElems = 2;
-            }
-        } else {
-            if (poisonElems == 2) {
-                poisonElems = 0;
-                logPrint(L_ZERO, 0, "\t  [%3d] %zX (POISON)\n", index-1, POISON_ELEM);
-            }
-            logPrint(L_ZERO, 0, "\t  [%3d] " STK_ELEM_FMT "\n", index, stk->data[index]);
-        }
-    }
-    if (poisonElems == 2) {
-        poisonElems = 0;
-        logPrint(L_ZERO, 0, "\t  [%3d] %zX (POISON)\n", stk->capacity-1, POISON_ELEM);
+    if (stk->poisonMode == POISON_ASAN) {
+        // Reading it would be caught by sanitizer
+        if (stk->size < stk->capacity)
+            dumpPrintf(&buf, "\t  [%3zu..%3zu] (ASAN POISON)\n", stk->size, stk->capacity-1);
+    } else {
+        size_t highWater = (stk->highWater < stk->capacity) ? stk->highWater : stk->capacity;
+        if (size < highWater)
+            dumpRange(&buf, stk->data, size, highWater, ' ', options);
+        if (stk->highWater < stk->capacity)
+            dumpPrintf(&buf, "\t  [%3zu..%3zu] (NOT INITIALIZED)\n", stk->highWater, stk->capacity-1);
     }
+    dumpPrintf(&buf, "\t}\n");
 
-    logPrint(L_ZERO, 0, "\t}\n");
+    dumpFlush(&buf);
+    free(buf.data);
     return true;
 }
 
-StackError_t stackDumpBase(Stack_t *stk, const char *file, int line, const char *function) {
+void stackSetDumpOptions(const StackDumpOptions_t *options) {
+    MY_ASSERT(options, abort());
+    globalDumpOptions = *options;
+}
+
+StackError_t stackDumpBase(Stack_t *stk, const StackDumpOptions_t *options,
+                           const char *file, int line, const char *function) {
 
     logPrintWithTime(L_ZERO, 0, "Stack_t dump:\n");
     logPrint(L_ZERO, 0, "called from %s:%d (%s)\n", file, line, function);
@@ -385,18 +1109,38 @@ StackError_t stackDumpBase(Stack_t *stk, const char *file, int line, const char
         logPrint(L_ZERO, 0, "\t!!!CAPACITY OVERFLOW\n");
     if (stkError & ERR_LOGIC)
         logPrint(L_ZERO, 0, "\t!!!SIZE > CAPACITY\n");
+    logPrint(L_ZERO, 0, "\tverify   = %d (period %zu, %zu ops)\n",
+                        stk->verifyLevel, stk->samplePeriod, stk->opCounter);
+    logPrint(L_ZERO, 0, "\tpoison   = %d (high water %zu)\n", stk->poisonMode, stk->highWater);
+    logPrint(L_ZERO, 0, "\tcheckpoint = %#.16zX, unchanged below %zu\n", stk->checkpointTag, stk->lowWater);
+    if (stk->fileMap)
+        logPrint(L_ZERO, 0, "\tfile     = fd %d, mapped at %p\n", stk->fileMap->fd, stk->fileMap->base);
+    logPrint(L_ZERO, 0, "\tpolicy   = grow x%g, shrink 1/%zu, min %zu, delay %zu/%zu\n",
+                        stk->policy.growFactor, stk->policy.shrinkRatio, stk->policy.minCapacity,
+                        stk->underusedOps, stk->policy.shrinkDelay);
+    ON_METRICS(
+    logPrint(L_ZERO, 0, "\tstats    = %zu pushes, %zu pops, peak size %zu\n",
+                        stk->stats.pushes, stk->stats.pops, stk->stats.peakSize);
+    logPrint(L_ZERO, 0, "\t           %zu grows, %zu shrinks, %zu bytes copied\n",
+                        stk->stats.grows, stk->stats.shrinks, stk->stats.bytesCopied);
+    logPrint(L_ZERO, 0, "\t           verify %zu calls %.3f ms, hash %zu calls %.3f ms\n",
+                        stk->stats.verifyCalls, (double) stk->stats.verifyNs / 1e6,
+                        stk->stats.hashCalls, (double) stk->stats.hashNs / 1e6);
+    )
 
-    stackDumpData(stk, stkError);
+    stackDumpData(stk, stkError, (options) ? options : &globalDumpOptions);
 
     ON_HASH(
-    logPrint(L_ZERO, 0, "\tdataHash  = %#.16zX\n", stk->dataHash);
+    logPrint(L_ZERO, 0, "\tdataHash  = %#.16zX:%#.16zX\n", stk->dataHash.chunks, stk->dataHash.tail);
     // Data hash should be calculated
     // a) if we calculated it in stackVerify, so ERR_HASH_DATA is set
     // Otherwise data may be corrupted, if
-    // b) There's errors ERR_DATA or ERR_HASH_STACK
-    if (stkError & ERR_HASH_DATA)                    /*(a)*/
-        logPrint(L_ZERO, 0, "\tWrong hash: %#.16zX is correct hash\n", getDataHash(stk));
-    else if (stkError & (ERR_DATA + ERR_HASH_STACK)) /*(b)*/
+    // b) There's errors ERR_DATA, ERR_LOGIC, ERR_SIZE or ERR_HASH_STACK
+    if (stkError & ERR_HASH_DATA) {                  /*(a)*/
+        memChunkHash_t correctHash = getDataHash(stk);
+        logPrint(L_ZERO, 0, "\tWrong hash: %#.16zX:%#.16zX is correct hash\n", correctHash.chunks, correctHash.tail);
+    }
+    else if (stkError & (ERR_DATA + ERR_LOGIC + ERR_SIZE + ERR_HASH_STACK)) /*(b)*/
         logPrint(L_ZERO, 0, "\tData may be corrupted, can't calculate hash\n");
 
     logPrint(L_ZERO, 0, "\tstackHash = %#.16zX\n", stk->stackHash);
@@ -418,38 +1162,429 @@ const char *stackFirstErrorToStr(StackError_t err) {
     errToStr(err, ERR_SIZE);
     errToStr(err, ERR_CAPACITY);
     errToStr(err, ERR_LOGIC);
-    ON_CANARY(
     errToStr(err, ERR_CANARY_LEFT);
     errToStr(err, ERR_CANARY_RIGHT);
     errToStr(err, ERR_DATA_CANARY_LEFT);
     errToStr(err, ERR_DATA_CANARY_RIGHT);
-    )
-    ON_HASH(
     errToStr(err, ERR_HASH_DATA);
     errToStr(err, ERR_HASH_STACK);
-    )
+    errToStr(err, ERR_EMPTY);
+    errToStr(err, ERR_FILE);
     return "STACK_OK";
     #undef errToStr
 }
 
+/*------------------REGISTRY AND SCRUBBER-------------------------------------*/
+
+static const int    SCRUB_TRIES      = 4;           ///< Checks of stack changed during them before it is skipped
+static const size_t SCRUB_IDLE_NS    = 10000000;    ///< Pause when there are no stacks
+static const size_t SCRUB_SLICE_NS   = 10000000;    ///< Longest sleep without looking at stop flag
+
+static Stack_t *registryHead    = NULL;
+static Stack_t *registryCursor  = NULL;     ///< Next stack to be checked by scrubber
+static size_t   registrySize    = 0;
+static bool     registryLocked  = false;
+
+static Stack_t *scrubPinned = NULL;         ///< Stack checked by scrubber, its block can't be freed or poisoned
+static std::thread *scrubThread = NULL;
+static bool scrubStop = false;
+static size_t scrubRate = 0;
+static StackScrubCallback_t scrubCallback = NULL;
+static void *scrubCtx = NULL;
+static StackScrubStats_t scrubStats = {};
+
+/// @brief Line of stackDumpAll, copied from stack under registry lock
+typedef struct {
+    const Stack_t *stk;
+    StackMemory_t memory;
+    size_t size;
+    size_t capacity;
+    const char *allocator;
+    bool isInline;
+    ON_DEBUG(
+    const char *name;
+    const char *initFile;
+    int initLine;
+    )
+} registryLine_t;
+
+static void registryLock();
+static void registryUnlock();
+static void stackReadMemory(Stack_t *stk, StackMemory_t *memory, registryLine_t *line);
+static size_t memoryReserved(const StackMemory_t *memory);
+static size_t memoryWasted(const StackMemory_t *memory);
+static int compareWaste(const void *first, const void *second);
+static Stack_t *scrubPinNext();
+static void scrubStack(Stack_t *stk);
+static void scrubPause(uint64_t ns);
+static void scrubLoop();
+
+static void registryLock() {
+    while (__atomic_test_and_set(&registryLocked, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+}
+
+static void registryUnlock() {
+    __atomic_clear(&registryLocked, __ATOMIC_RELEASE);
+}
+
+/// Seqlock of stack: scrubber drops result of check that overlapped with change
+static void stackWriteBegin(Stack_t *stk) {
+    __atomic_store_n(&stk->writeSeq, stk->writeSeq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    // Every change counts once for VERIFY_SAMPLED, however many checks operation does
+    stk->opCounter++;
+}
+
+static void stackWriteEnd(Stack_t *stk) {
+    __atomic_store_n(&stk->writeSeq, stk->writeSeq + 1, __ATOMIC_RELEASE);
+}
+
+/// Called in write section: scrubber that pinned stack before it could miss odd writeSeq
+static void stackWaitScrubber(Stack_t *stk) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&scrubPinned, __ATOMIC_ACQUIRE) == stk)
+        std::this_thread::yield();
+}
+
+static void stackRegistryAdd(Stack_t *stk) {
+    registryLock();
+    stk->registryPrev = NULL;
+    stk->registryNext = registryHead;
+    if (registryHead)
+        registryHead->registryPrev = stk;
+    registryHead = stk;
+    registrySize++;
+    registryUnlock();
+}
+
+/// After it scrubber can't reach stack, so stack can be freed
+static void stackRegistryRemove(Stack_t *stk) {
+    registryLock();
+    // Stack that was never constructed isn't in list
+    if (stk->registryPrev || registryHead == stk) {
+        if (registryCursor == stk)
+            registryCursor = stk->registryNext;
+        if (stk->registryPrev)
+            stk->registryPrev->registryNext = stk->registryNext;
+        else
+            registryHead = stk->registryNext;
+        if (stk->registryNext)
+            stk->registryNext->registryPrev = stk->registryPrev;
+        stk->registryPrev = stk->registryNext = NULL;
+        registrySize--;
+    }
+    registryUnlock();
+    stackWaitScrubber(stk);
+}
+
+size_t stackRegistryCount() {
+    registryLock();
+    size_t count = registrySize;
+    registryUnlock();
+    return count;
+}
+
+/// Adds stack to memory, fields are read under seqlock because owner may change stack meanwhile
+static void stackReadMemory(Stack_t *stk, StackMemory_t *memory, registryLine_t *line) {
+    size_t seq = 0, size = 0, capacity = 0;
+    bool isInline = false;
+    for (int i = 0; i < SCRUB_TRIES; i++) {
+        seq = __atomic_load_n(&stk->writeSeq, __ATOMIC_ACQUIRE);
+        size     = stk->size;
+        capacity = stk->capacity;
+        isInline = stackIsInline(stk);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq % 2 == 0 && __atomic_load_n(&stk->writeSeq, __ATOMIC_RELAXED) == seq)
+            break;
+    }
+    StackMemory_t own = {};
+    own.stacks        = 1;
+    own.usedBytes     = size * sizeof(stkElem_t);
+    own.capacityBytes = capacity * sizeof(stkElem_t);
+    own.blockBytes    = (isInline || capacity == 0) ? 0 : getBlockSize(capacity * sizeof(stkElem_t));
+    own.structBytes   = sizeof(Stack_t);
+
+    memory->stacks        += own.stacks;
+    memory->usedBytes     += own.usedBytes;
+    memory->capacityBytes += own.capacityBytes;
+    memory->blockBytes    += own.blockBytes;
+    memory->structBytes   += own.structBytes;
+    if (!line)
+        return;
+    line->stk       = stk;
+    line->memory    = own;
+    line->size      = size;
+    line->capacity  = capacity;
+    line->allocator = (stk->allocator) ? stk->allocator->name : "?";
+    line->isInline  = isInline;
+    ON_DEBUG(
+    line->name     = stk->name;
+    line->initFile = stk->initFile;
+    line->initLine = stk->initLine;
+    )
+}
+
+/// Data blocks and structs
+static size_t memoryReserved(const StackMemory_t *memory) {
+    return memory->blockBytes + memory->structBytes;
+}
+
+/// Unused capacity, canaries and padding of allocated block of one stack
+static size_t memoryWasted(const StackMemory_t *memory) {
+    return (memory->blockBytes) ? memory->blockBytes - memory->usedBytes : 0;
+}
+
+static int compareWaste(const void *first, const void *second) {
+    size_t firstWaste  = memoryWasted(&((const registryLine_t *) first)->memory);
+    size_t secondWaste = memoryWasted(&((const registryLine_t *) second)->memory);
+    return (firstWaste < secondWaste) - (firstWaste > secondWaste);
+}
+
+StackMemory_t stackGetMemory(Stack_t *stk) {
+    STACK_ASSERT(stk);
+    StackMemory_t memory = {};
+    stackReadMemory(stk, &memory, NULL);
+    return memory;
+}
+
+StackMemory_t stackRegistryMemory() {
+    StackMemory_t memory = {};
+    registryLock();
+    for (Stack_t *stk = registryHead; stk; stk = stk->registryNext)
+        stackReadMemory(stk, &memory, NULL);
+    registryUnlock();
+    return memory;
+}
+
+void stackDumpAllBase(const char *file, int line, const char *function) {
+    // Lines are collected under lock and printed after it, so logging doesn't hold constructors
+    registryLock();
+    size_t count = registrySize;
+    registryLine_t *lines = (registryLine_t *) calloc(count ? count : 1, sizeof(registryLine_t));
+    MY_ASSERT(lines, abort());
+    StackMemory_t total = {};
+    size_t index = 0;
+    for (Stack_t *stk = registryHead; stk; stk = stk->registryNext)
+        stackReadMemory(stk, &total, &lines[index++]);
+    registryUnlock();
+    qsort(lines, count, sizeof(registryLine_t), compareWaste);
+
+    size_t reserved = memoryReserved(&total), wasted = 0;
+    for (size_t i = 0; i < count; i++)
+        wasted += memoryWasted(&lines[i].memory);
+    logPrintWithTime(L_ZERO, 0, "Stack registry dump:\n");
+    logPrint(L_ZERO, 0, "called from %s:%d (%s)\n", file, line, function);
+    logPrint(L_ZERO, 0, "%zu stacks: %zu bytes used of %zu reserved (%zu in blocks, %zu in structs), "
+                        "%zu%% of blocks wasted\n", total.stacks, total.usedBytes, reserved, total.blockBytes,
+                        total.structBytes, (total.blockBytes) ? wasted * 100 / total.blockBytes : 0);
+    logPrint(L_ZERO, 0, "\t%-18s %10s %10s %12s %12s %6s %-8s %s\n",
+                        "stack", "size", "capacity", "used B", "block B", "waste", "alloc", "name");
+    size_t shown = (count < STACK_DUMP_ALL_LINES) ? count : STACK_DUMP_ALL_LINES;
+    for (size_t i = 0; i < shown; i++) {
+        const registryLine_t *entry = &lines[i];
+        size_t waste = memoryWasted(&entry->memory);
+        size_t blockBytes = entry->memory.blockBytes;
+        const char *mark = (!entry->isInline && blockBytes && waste * 2 >= blockBytes) ? " trim" : "";
+#ifndef NDEBUG
+        logPrint(L_ZERO, 0, "\t%-18p %10zu %10zu %12zu %12zu %5zu%% %-8s \"%s\" %s:%d%s\n",
+                            entry->stk, entry->size, entry->capacity, entry->memory.usedBytes, blockBytes,
+                            (blockBytes) ? waste * 100 / blockBytes : 0, (entry->isInline) ? "inline" : entry->allocator,
+                            entry->name, entry->initFile, entry->initLine, mark);
+#else
+        logPrint(L_ZERO, 0, "\t%-18p %10zu %10zu %12zu %12zu %5zu%% %-8s -%s\n",
+                            entry->stk, entry->size, entry->capacity, entry->memory.usedBytes, blockBytes,
+                            (blockBytes) ? waste * 100 / blockBytes : 0, (entry->isInline) ? "inline" : entry->allocator,
+                            mark);
+#endif
+    }
+    if (shown < count)
+        logPrint(L_ZERO, 0, "\t... %zu more stacks\n", count - shown);
+    free(lines);
+}
+
+/// Take next stack from registry and pin it, so its owner can't free it until check ends
+static Stack_t *scrubPinNext() {
+    registryLock();
+    Stack_t *stk = (registryCursor) ? registryCursor : registryHead;
+    if (stk) {
+        registryCursor = stk->registryNext;
+        if (!registryCursor)
+            __atomic_add_fetch(&scrubStats.passes, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&scrubPinned, stk, __ATOMIC_RELAXED);
+    }
+    registryUnlock();
+    // Pairs with fence of stackWaitScrubber: either writer sees pin or scrubber sees odd writeSeq
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return stk;
+}
+
+/// Full check of pinned stack, retried if its owner changed stack meanwhile
+static void scrubStack(Stack_t *stk) {
+    if (stk->scrubReported)
+        return;
+    for (int i = 0; i < SCRUB_TRIES; i++) {
+        // Owner may be waiting for pin to be released, so stack is left at once
+        size_t seq = __atomic_load_n(&stk->writeSeq, __ATOMIC_ACQUIRE);
+        if (seq % 2)
+            break;
+        StackError_t err = stackVerify(stk);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&stk->writeSeq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        __atomic_add_fetch(&scrubStats.checked, 1, __ATOMIC_RELAXED);
+        if (err) {
+            stk->scrubReported = true;
+            __atomic_add_fetch(&scrubStats.errors, 1, __ATOMIC_RELAXED);
+            logPrintWithTime(L_ZERO, 1, "Scrubber found error in Stack_t[%p]: %s\n", stk, stackFirstErrorToStr(err));
+            stackDump(stk);
+            if (scrubCallback)
+                scrubCallback(stk, err, scrubCtx);
+        }
+        return;
+    }
+    __atomic_add_fetch(&scrubStats.busy, 1, __ATOMIC_RELAXED);
+}
+
+static void scrubPause(uint64_t ns) {
+    while (ns && !__atomic_load_n(&scrubStop, __ATOMIC_ACQUIRE)) {
+        uint64_t slice = (ns < SCRUB_SLICE_NS) ? ns : SCRUB_SLICE_NS;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(slice));
+        ns -= slice;
+    }
+}
+
+static void scrubLoop() {
+    isScrubberThread = true;
+    while (!__atomic_load_n(&scrubStop, __ATOMIC_ACQUIRE)) {
+        Stack_t *stk = scrubPinNext();
+        if (!stk) {
+            scrubPause(SCRUB_IDLE_NS);
+            continue;
+        }
+        scrubStack(stk);
+        __atomic_store_n(&scrubPinned, NULL, __ATOMIC_RELEASE);
+
+        size_t rate = __atomic_load_n(&scrubRate, __ATOMIC_RELAXED);
+        if (rate)
+            scrubPause(1000000000 / rate);
+    }
+}
+
+StackError_t stackScrubStart(size_t stacksPerSecond, StackScrubCallback_t callback, void *ctx) {
+    stackScrubStop();
+    logPrintWithTime(L_DEBUG, 0, "Starting stack scrubber: %zu stacks/s\n", stacksPerSecond);
+    scrubRate     = stacksPerSecond;
+    scrubCallback = callback;
+    scrubCtx      = ctx;
+    scrubStats    = {};
+    __atomic_store_n(&scrubStop, false, __ATOMIC_RELEASE);
+    scrubThread = new std::thread(scrubLoop);
+    return STACK_OK;
+}
+
+void stackScrubSetRate(size_t stacksPerSecond) {
+    __atomic_store_n(&scrubRate, stacksPerSecond, __ATOMIC_RELAXED);
+}
+
+void stackScrubStop() {
+    if (!scrubThread)
+        return;
+    __atomic_store_n(&scrubStop, true, __ATOMIC_RELEASE);
+    scrubThread->join();
+    delete scrubThread;
+    scrubThread = NULL;
+    logPrintWithTime(L_DEBUG, 0, "Stack scrubber stopped: %zu passes, %zu checked, %zu busy, %zu errors\n",
+                     scrubStats.passes, scrubStats.checked, scrubStats.busy, scrubStats.errors);
+}
+
+StackScrubStats_t stackScrubGetStats() {
+    StackScrubStats_t stats = {};
+    stats.passes  = __atomic_load_n(&scrubStats.passes,  __ATOMIC_RELAXED);
+    stats.checked = __atomic_load_n(&scrubStats.checked, __ATOMIC_RELAXED);
+    stats.busy    = __atomic_load_n(&scrubStats.busy,    __ATOMIC_RELAXED);
+    stats.errors  = __atomic_load_n(&scrubStats.errors,  __ATOMIC_RELAXED);
+    return stats;
+}
+
 
 ON_HASH(
-static uint64_t getDataHash(Stack_t *stk) {
+// Hash of [0, size) only, so it can be maintained with memChunkHashGrow/memChunkHashShrink
+static memChunkHash_t getDataHash(Stack_t *stk) {
     MY_ASSERT(stk, abort());
-    return memHash(stk->data, stk->capacity*sizeof(stkElem_t));
+    ON_METRICS(uint64_t start = metricsNowNs();)
+    memChunkHash_t hash = memChunkHashCompute(stk->data, stk->size*sizeof(stkElem_t));
+    ON_METRICS(metricsCountHash(stk, start);)
+    return hash;
+}
+
+static void stackDataHashGrow(Stack_t *stk, size_t oldSize, size_t newSize) {
+    ON_METRICS(uint64_t start = metricsNowNs();)
+    memChunkHashGrow(&stk->dataHash, stk->data, oldSize * sizeof(stkElem_t), newSize * sizeof(stkElem_t));
+    ON_METRICS(metricsCountHash(stk, start);)
+}
+
+static void stackDataHashShrink(Stack_t *stk, size_t oldSize, size_t newSize) {
+    ON_METRICS(uint64_t start = metricsNowNs();)
+    memChunkHashShrink(&stk->dataHash, stk->data, oldSize * sizeof(stkElem_t), newSize * sizeof(stkElem_t));
+    ON_METRICS(metricsCountHash(stk, start);)
 }
 
 static uint64_t getStackHash(Stack_t *stk) {
     const hash_t magicNumber = 1337;
     MY_ASSERT(stk, abort());
-    uint64_t oldHash = stk->stackHash;
-    stk->stackHash = magicNumber;
-    uint64_t newHash = memHash(stk, sizeof(Stack_t));
-    stk->stackHash = oldHash;
+    ON_METRICS(uint64_t start = metricsNowNs();)
+    // Hash is computed on copy, so check never writes to stack checked from another thread.
+    // Fields after stackHash are changed by checks and registry, inline block is covered
+    // by dataHash and its unused part may be poisoned for sanitizer
+    const size_t hashedBytes = offsetof(Stack_t, writeSeq);
+    Stack_t copy;
+    memcpy(&copy, stk, hashedBytes);
+    copy.stackHash = magicNumber;
+    copy.opCounter = 0;
+    uint64_t newHash = memHash(&copy, hashedBytes);
+    ON_METRICS(metricsCountHash(stk, start);)
     return newHash;
 }
 )
 
+ON_METRICS(
+static uint64_t metricsNowNs() {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// Called before capacity is changed
+static void metricsCountResize(Stack_t *stk, size_t newCapacity, size_t bytesCopied) {
+    if (newCapacity > stk->capacity)
+        stk->stats.grows++;
+    else if (newCapacity < stk->capacity)
+        stk->stats.shrinks++;
+    stk->stats.bytesCopied += bytesCopied;
+}
+
+static void metricsCountSize(Stack_t *stk) {
+    if (stk->size > stk->stats.peakSize)
+        stk->stats.peakSize = stk->size;
+}
+
+static void metricsCountHash(Stack_t *stk, uint64_t start) {
+    if (isScrubberThread)
+        return;
+    stk->stats.hashCalls++;
+    stk->stats.hashNs += metricsNowNs() - start;
+}
+
+static void metricsCountVerify(Stack_t *stk, uint64_t start) {
+    if (isScrubberThread)
+        return;
+    stk->stats.verifyCalls++;
+    stk->stats.verifyNs += metricsNowNs() - start;
+}
+)
+
 ON_CANARY(
 static bool canaryOk(canary_t canary, void *ptr) {
     return ((canary ^ XOR_CONST) == (size_t)ptr);
@@ -0,0 +1,172 @@
+#define LOG_SUBSYSTEM LOG_SUB_STACK
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sched.h>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "cStack.h"
+#include "lfStack.h"
+#include "elimStack.h"
+
+static size_t randomSlot(size_t slotsCount);
+static bool exchangePush(ElimStack_t *stk, lfNode_t *node);
+static lfNode_t *exchangePop(ElimStack_t *stk);
+
+/// xorshift, every thread has its own state
+static size_t randomSlot(size_t slotsCount) {
+    static thread_local uint64_t state = 0;
+    if (!state)
+        state = (uint64_t) &state | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state % slotsCount;
+}
+
+/// Offer node in random slot and wait for pop to take it
+/// @return true if node was taken
+static bool exchangePush(ElimStack_t *stk, lfNode_t *node) {
+    lfTagged_t *slot = stk->slots + randomSlot(stk->slotsCount);
+    lfTagged_t old = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (lfTaggedPtr(old))
+        return false;
+
+    lfTagged_t offer = lfTaggedNext(old, node);
+    if (!__atomic_compare_exchange_n(slot, &old, offer, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return false;
+
+    // Lets pop run while offer is up, even on single CPU
+    if (stk->eliminateFirst)
+        sched_yield();
+    for (size_t spin = 0; spin < stk->backoffSpins; spin++)
+        if (__atomic_load_n(slot, __ATOMIC_ACQUIRE) != offer)
+            return true;
+
+    // Withdraw offer; if it fails, pop has taken node in the meantime
+    return !__atomic_compare_exchange_n(slot, &offer, lfTaggedNext(offer, NULL), false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+}
+
+/// Wait in random slot for push offer
+/// @return taken node or NULL
+static lfNode_t *exchangePop(ElimStack_t *stk) {
+    lfTagged_t *slot = stk->slots + randomSlot(stk->slotsCount);
+    for (size_t spin = 0; spin < stk->backoffSpins; spin++) {
+        lfTagged_t old = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        lfNode_t *node = lfTaggedPtr(old);
+        if (!node)
+            continue;
+        if (__atomic_compare_exchange_n(slot, &old, lfTaggedNext(old, NULL), false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return node;
+    }
+    return NULL;
+}
+
+StackError_t elimStackCtor(ElimStack_t *stk, size_t slotsCount, size_t backoffSpins) {
+    MY_ASSERT(stk, abort());
+    memset(stk, 0, sizeof(*stk));
+    lfStackCtor(&stk->central);
+    stk->slotsCount   = slotsCount   ? slotsCount   : ELIM_DEFAULT_SLOTS;
+    stk->backoffSpins = backoffSpins ? backoffSpins : ELIM_DEFAULT_BACKOFF;
+    stk->slots = (lfTagged_t *) calloc(stk->slotsCount, sizeof(lfTagged_t));
+    MY_ASSERT(stk->slots, abort());
+    logPrintWithTime(L_DEBUG, 0, "ElimStack_t[%p] created: %zu slots, %zu spins\n",
+                     stk, stk->slotsCount, stk->backoffSpins);
+    return STACK_OK;
+}
+
+StackError_t elimStackDtor(ElimStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    // Offers are withdrawn or taken before push returns, so slots are empty here
+    lfStackDtor(&stk->central);
+    free(stk->slots);
+    memset(stk, 0, sizeof(*stk));
+    return STACK_OK;
+}
+
+StackError_t elimStackSetEliminateFirst(ElimStack_t *stk, bool eliminateFirst) {
+    MY_ASSERT(stk, abort());
+    stk->eliminateFirst = eliminateFirst;
+    return STACK_OK;
+}
+
+StackError_t elimStackPush(ElimStack_t *stk, stkElem_t val) {
+    MY_ASSERT(stk, abort());
+    lfNode_t *node = lfNodeAlloc(&stk->central);
+    __atomic_store_n(&node->val, val, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stk->central.size, 1, __ATOMIC_RELAXED);
+
+    // With eliminateFirst node is offered in elimination array before first CAS
+    bool eliminate = stk->eliminateFirst;
+    while (true) {
+        if (!eliminate && lfStackTryPush(&stk->central, node)) {
+            __atomic_add_fetch(&stk->stats.centralPushes, 1, __ATOMIC_RELAXED);
+            return STACK_OK;
+        }
+        eliminate = false;
+        if (exchangePush(stk, node)) {
+            __atomic_sub_fetch(&stk->central.size, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&stk->stats.eliminatedPushes, 1, __ATOMIC_RELAXED);
+            return STACK_OK;
+        }
+    }
+}
+
+StackError_t elimStackPop(ElimStack_t *stk, stkElem_t *val) {
+    MY_ASSERT(stk && val, abort());
+    lfNode_t *node = NULL;
+    // With eliminateFirst first attempt is treated as failed CAS, so it goes to elimination array
+    bool eliminate = stk->eliminateFirst;
+    while (true) {
+        StackError_t err = ERR_LOGIC;
+        if (!eliminate)
+            err = lfStackTryPop(&stk->central, &node);
+        eliminate = false;
+        if (err == STACK_OK) {
+            __atomic_sub_fetch(&stk->central.size, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&stk->stats.centralPops, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        // Empty central stack is not final: push may be waiting in elimination array
+        if ((node = exchangePop(stk)) != NULL) {
+            lfNodeVerify(node);
+            __atomic_add_fetch(&stk->stats.eliminatedPops, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (err == ERR_EMPTY) {
+            __atomic_add_fetch(&stk->stats.emptyPops, 1, __ATOMIC_RELAXED);
+            return ERR_EMPTY;
+        }
+    }
+
+    *val = __atomic_load_n(&node->val, __ATOMIC_RELAXED);
+    lfNodeFree(&stk->central, node);
+    return STACK_OK;
+}
+
+StackError_t elimStackTop(ElimStack_t *stk, stkElem_t *val) {
+    MY_ASSERT(stk, abort());
+    return lfStackTop(&stk->central, val);
+}
+
+size_t elimStackGetSize(ElimStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    return lfStackGetSize(&stk->central);
+}
+
+ElimStackStats_t elimStackGetStats(ElimStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    ElimStackStats_t stats = {};
+    stats.centralPushes    = __atomic_load_n(&stk->stats.centralPushes,    __ATOMIC_RELAXED);
+    stats.centralPops      = __atomic_load_n(&stk->stats.centralPops,      __ATOMIC_RELAXED);
+    stats.eliminatedPushes = __atomic_load_n(&stk->stats.eliminatedPushes, __ATOMIC_RELAXED);
+    stats.eliminatedPops   = __atomic_load_n(&stk->stats.eliminatedPops,   __ATOMIC_RELAXED);
+    stats.emptyPops        = __atomic_load_n(&stk->stats.emptyPops,        __ATOMIC_RELAXED);
+    return stats;
+}
@@ -0,0 +1,158 @@
+#define LOG_SUBSYSTEM LOG_SUB_STACK
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "utils.h"
+#include "cStack.h"
+#include "lfStack.h"
+
+static lfNode_t *listPop(lfTagged_t *list, StackError_t *err);
+static bool listTryPush(lfTagged_t *list, lfNode_t *node);
+
+static bool listTryPush(lfTagged_t *list, lfNode_t *node) {
+    lfTagged_t old = __atomic_load_n(list, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->next, lfTaggedPtr(old), __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(list, &old, lfTaggedNext(old, node), true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/// Single CAS attempt, err is ERR_EMPTY or ERR_LOGIC (CAS failed) when NULL is returned
+static lfNode_t *listPop(lfTagged_t *list, StackError_t *err) {
+    lfTagged_t old = __atomic_load_n(list, __ATOMIC_ACQUIRE);
+    lfNode_t *node = lfTaggedPtr(old);
+    if (!node) {
+        *err = ERR_EMPTY;
+        return NULL;
+    }
+    // node can't be freed while stack is alive, so this read is safe;
+    // if node was popped and pushed again meanwhile, tag makes CAS fail
+    lfNode_t *next = __atomic_load_n(&node->next, __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(list, &old, lfTaggedNext(old, next), true,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        *err = ERR_LOGIC;
+        return NULL;
+    }
+    *err = STACK_OK;
+    return node;
+}
+
+lfNode_t *lfNodeAlloc(LfStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    StackError_t err = STACK_OK;
+    lfNode_t *node = NULL;
+    do {
+        node = listPop(&stk->freeList, &err);
+    } while (err == ERR_LOGIC);
+
+    if (!node) {
+        node = (lfNode_t *) calloc(1, sizeof(lfNode_t));
+        MY_ASSERT(node, abort());
+        MY_ASSERT(((uint64_t) node & ~LF_PTR_MASK) == 0, abort());
+        logPrintWithTime(L_EXTRA, 0, "LfStack_t[%p] new node: %p\n", stk, node);
+    }
+    ON_CANARY(
+    node->goose1 = node->goose2 = (canary_t) node ^ XOR_CONST;
+    )
+    return node;
+}
+
+void lfNodeFree(LfStack_t *stk, lfNode_t *node) {
+    MY_ASSERT(stk && node, abort());
+    __atomic_store_n(&node->val, POISON_ELEM, __ATOMIC_RELAXED);
+    while (!listTryPush(&stk->freeList, node))
+        ;
+}
+
+void lfNodeVerify(lfNode_t *node) {
+    (void) node;
+    ON_CANARY(
+    if ((node->goose1 ^ XOR_CONST) != (canary_t) node || (node->goose2 ^ XOR_CONST) != (canary_t) node) {
+        logPrintWithTime(L_ZERO, 1, "lfNode_t[%p] canaries are broken: %zX %zX, must be %zX\n",
+                         node, node->goose1, node->goose2, (canary_t) node ^ XOR_CONST);
+        abort();
+    }
+    )
+}
+
+bool lfStackTryPush(LfStack_t *stk, lfNode_t *node) {
+    return listTryPush(&stk->top, node);
+}
+
+StackError_t lfStackTryPop(LfStack_t *stk, lfNode_t **node) {
+    StackError_t err = STACK_OK;
+    *node = listPop(&stk->top, &err);
+    if (*node)
+        lfNodeVerify(*node);
+    return err;
+}
+
+StackError_t lfStackCtor(LfStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    memset(stk, 0, sizeof(*stk));
+    return STACK_OK;
+}
+
+StackError_t lfStackDtor(LfStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    lfTagged_t lists[] = {stk->top, stk->freeList};
+    for (size_t idx = 0; idx < ARRAY_SIZE(lists); idx++) {
+        lfNode_t *node = lfTaggedPtr(lists[idx]);
+        while (node) {
+            lfNode_t *next = node->next;
+            free(node);
+            node = next;
+        }
+    }
+    memset(stk, 0, sizeof(*stk));
+    return STACK_OK;
+}
+
+StackError_t lfStackPush(LfStack_t *stk, stkElem_t val) {
+    MY_ASSERT(stk, abort());
+    lfNode_t *node = lfNodeAlloc(stk);
+    __atomic_store_n(&node->val, val, __ATOMIC_RELAXED);
+    // size is increased before push and decreased after pop, so it never underflows
+    __atomic_add_fetch(&stk->size, 1, __ATOMIC_RELAXED);
+    while (!lfStackTryPush(stk, node))
+        ;
+    return STACK_OK;
+}
+
+StackError_t lfStackPop(LfStack_t *stk, stkElem_t *val) {
+    MY_ASSERT(stk && val, abort());
+    lfNode_t *node = NULL;
+    StackError_t err = STACK_OK;
+    while ((err = lfStackTryPop(stk, &node)) == ERR_LOGIC)
+        ;
+    if (err)
+        return err;
+
+    __atomic_sub_fetch(&stk->size, 1, __ATOMIC_RELAXED);
+    *val = __atomic_load_n(&node->val, __ATOMIC_RELAXED);
+    lfNodeFree(stk, node);
+    return STACK_OK;
+}
+
+StackError_t lfStackTop(LfStack_t *stk, stkElem_t *val) {
+    MY_ASSERT(stk && val, abort());
+    lfTagged_t top = 0;
+    do {
+        top = __atomic_load_n(&stk->top, __ATOMIC_ACQUIRE);
+        if (!lfTaggedPtr(top))
+            return ERR_EMPTY;
+        *val = __atomic_load_n(&lfTaggedPtr(top)->val, __ATOMIC_RELAXED);
+        // node could be popped and reused while we read it: check that top didn't change
+    } while (__atomic_load_n(&stk->top, __ATOMIC_ACQUIRE) != top);
+    return STACK_OK;
+}
+
+size_t lfStackGetSize(LfStack_t *stk) {
+    MY_ASSERT(stk, abort());
+    return __atomic_load_n(&stk->size, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+#include "error_debug.h"
+#include "logBinary.h"
+
+/// @brief How argument of conversion is stored
+enum LogArgType {
+    LOG_ARG_NONE,           ///< %% or unknown conversion
+    LOG_ARG_INT,            ///< int32
+    LOG_ARG_LONG,           ///< int64
+    LOG_ARG_DOUBLE,         ///< double
+    LOG_ARG_LONG_DOUBLE,    ///< long double
+    LOG_ARG_STRING,         ///< uint32 length and bytes
+    LOG_ARG_POINTER         ///< uint64
+};
+
+/// @brief One printf conversion in format string
+typedef struct {
+    const char *start;      ///< '%'
+    const char *modifier;   ///< Length modifier (or conversion if there is none)
+    const char *end;        ///< After conversion
+    char conversion;        ///< Conversion specifier
+    enum LogArgType type;   ///< Type of value
+    int stars;              ///< Number of '*' in width and precision
+    bool starPrecision;     ///< Precision is the last '*'
+    int precision;          ///< Precision given by digits, -1 if there is none
+} LogConversion_t;
+
+static const size_t MAX_STARS = 2;
+static const uint32_t NULL_STRING = UINT32_MAX;
+
+static const char *nextConversion(const char *fmt, LogConversion_t *conv);
+static enum LogArgType getArgType(char conversion, const char *modifier, size_t modifierLen);
+static void bufferAppend(LogRecordBuffer_t *buffer, const void *bytes, size_t len);
+static void encodeHeader(LogRecordBuffer_t *buffer, size_t pos, LogRecordHeader_t *header);
+static bool readArg(const char **args, const char *argsEnd, void *value, size_t len);
+
+/*------------------FORMAT PARSING--------------------------------------------*/
+
+/// @return Conversion after fmt or NULL if there are no complete conversions left
+static const char *nextConversion(const char *fmt, LogConversion_t *conv) {
+    MY_ASSERT(fmt, abort());
+    MY_ASSERT(conv, abort());
+    const char *pos = strchr(fmt, '%');
+    if (!pos)
+        return NULL;
+
+    *conv = {};
+    conv->start = pos++;
+    conv->precision = -1;
+    while (*pos && strchr("-+ #0'", *pos))
+        pos++;
+    if (*pos == '*') {
+        conv->stars++;
+        pos++;
+    }
+    while (*pos >= '0' && *pos <= '9')
+        pos++;
+    if (*pos == '.') {
+        pos++;
+        if (*pos == '*') {
+            conv->stars++;
+            conv->starPrecision = true;
+            pos++;
+        } else {
+            conv->precision = 0;
+            for (; *pos >= '0' && *pos <= '9'; pos++)
+                conv->precision = conv->precision * 10 + (*pos - '0');
+        }
+    }
+    conv->modifier = pos;
+    while (*pos && strchr("hlLqjzZt", *pos))
+        pos++;
+    if (!*pos)
+        return NULL;
+
+    conv->conversion = *pos;
+    conv->type = getArgType(*pos, conv->modifier, (size_t) (pos - conv->modifier));
+    conv->end = pos + 1;
+    return conv->start;
+}
+
+static enum LogArgType getArgType(char conversion, const char *modifier, size_t modifierLen) {
+    bool isLong = modifierLen > 0 && strchr("lqjzZt", *modifier);
+    switch (conversion) {
+        case 'c':
+            return LOG_ARG_INT;
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            return (isLong) ? LOG_ARG_LONG : LOG_ARG_INT;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            return (modifierLen > 0 && *modifier == 'L') ? LOG_ARG_LONG_DOUBLE : LOG_ARG_DOUBLE;
+        case 's':
+            return (isLong) ? LOG_ARG_POINTER : LOG_ARG_STRING;
+        case 'p': case 'n':
+            return LOG_ARG_POINTER;
+        default:
+            return LOG_ARG_NONE;
+    }
+}
+
+/*------------------ENCODING--------------------------------------------------*/
+
+void logRecordBufferInit(LogRecordBuffer_t *buffer) {
+    MY_ASSERT(buffer, abort());
+    buffer->data = buffer->local;
+    buffer->size = 0;
+    buffer->capacity = sizeof(buffer->local);
+}
+
+void logRecordBufferFree(LogRecordBuffer_t *buffer) {
+    MY_ASSERT(buffer, abort());
+    if (buffer->data != buffer->local)
+        free(buffer->data);
+    logRecordBufferInit(buffer);
+}
+
+static void bufferAppend(LogRecordBuffer_t *buffer, const void *bytes, size_t len) {
+    if (buffer->size + len > buffer->capacity) {
+        size_t newCapacity = (2 * buffer->capacity > buffer->size + len) ? 2 * buffer->capacity : buffer->size + len;
+        char *newData = (char *) malloc(newCapacity);
+        MY_ASSERT(newData, abort());
+        memcpy(newData, buffer->data, buffer->size);
+        if (buffer->data != buffer->local)
+            free(buffer->data);
+        buffer->data = newData;
+        buffer->capacity = newCapacity;
+    }
+    memcpy(buffer->data + buffer->size, bytes, len);
+    buffer->size += len;
+}
+
+/// Header is written after record body, when its length is known
+static void encodeHeader(LogRecordBuffer_t *buffer, size_t pos, LogRecordHeader_t *header) {
+    header->len = (uint32_t) (buffer->size - pos - sizeof(*header));
+    memcpy(buffer->data + pos, header, sizeof(*header));
+}
+
+void logEncodeFormat(LogRecordBuffer_t *buffer, const char *fmt) {
+    MY_ASSERT(buffer, abort());
+    MY_ASSERT(fmt, abort());
+    LogRecordHeader_t header = {LOG_RECORD_FORMAT, 0, 0, (uintptr_t) fmt, 0};
+    size_t pos = buffer->size;
+    bufferAppend(buffer, &header, sizeof(header));
+    bufferAppend(buffer, fmt, strlen(fmt));
+    encodeHeader(buffer, pos, &header);
+}
+
+void logEncodeSession(LogRecordBuffer_t *buffer, int64_t timeNs) {
+    MY_ASSERT(buffer, abort());
+    LogRecordHeader_t header = {LOG_RECORD_SESSION, 0, 0, LOG_BINARY_MAGIC, timeNs};
+    bufferAppend(buffer, &header, sizeof(header));
+}
+
+void logEncodeMessage(LogRecordBuffer_t *buffer, bool withTime, int64_t timeNs, const char *fmt, va_list args) {
+    MY_ASSERT(buffer, abort());
+    MY_ASSERT(fmt, abort());
+    LogRecordHeader_t header = {LOG_RECORD_MESSAGE, withTime, 0, (uintptr_t) fmt, timeNs};
+    size_t pos = buffer->size;
+    bufferAppend(buffer, &header, sizeof(header));
+
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    LogConversion_t conv = {};
+    for (const char *cur = fmt; nextConversion(cur, &conv); cur = conv.end) {
+        int32_t star = -1;
+        for (int i = 0; i < conv.stars; i++) {
+            star = va_arg(argsCopy, int);
+            bufferAppend(buffer, &star, sizeof(star));
+        }
+        switch (conv.type) {
+            case LOG_ARG_INT: {
+                int32_t value = va_arg(argsCopy, int);
+                bufferAppend(buffer, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_LONG: {
+                int64_t value = va_arg(argsCopy, long long);
+                bufferAppend(buffer, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_DOUBLE: {
+                double value = va_arg(argsCopy, double);
+                bufferAppend(buffer, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_LONG_DOUBLE: {
+                long double value = va_arg(argsCopy, long double);
+                bufferAppend(buffer, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_POINTER: {
+                uint64_t value = (uintptr_t) va_arg(argsCopy, void *);
+                bufferAppend(buffer, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_STRING: {
+                const char *str = va_arg(argsCopy, const char *);
+                int precision = (conv.starPrecision) ? star : conv.precision;
+                // String with precision may be not terminated
+                uint32_t len = (!str) ? NULL_STRING :
+                               (uint32_t) ((precision >= 0) ? strnlen(str, (size_t) precision) : strlen(str));
+                bufferAppend(buffer, &len, sizeof(len));
+                if (str)
+                    bufferAppend(buffer, str, len);
+                break;
+            }
+            case LOG_ARG_NONE:
+            default:
+                break;
+        }
+    }
+    va_end(argsCopy);
+    encodeHeader(buffer, pos, &header);
+}
+
+/*------------------DECODING--------------------------------------------------*/
+
+static bool readArg(const char **args, const char *argsEnd, void *value, size_t len) {
+    if ((size_t) (argsEnd - *args) < len)
+        return false;
+    memcpy(value, *args, len);
+    *args += len;
+    return true;
+}
+
+// Conversion of every argument is printed by its own fprintf with spec rebuilt from format
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+#define PRINT_CONVERSION(value)                                                 \
+    do {                                                                        \
+        if (conv.stars == 0)      fprintf(out, spec, value);                    \
+        else if (conv.stars == 1) fprintf(out, spec, stars[0], value);          \
+        else                      fprintf(out, spec, stars[0], stars[1], value);\
+    } while(0)
+
+bool logDecodeMessage(FILE *out, const char *fmt, const char *args, size_t len) {
+    MY_ASSERT(out, abort());
+    MY_ASSERT(fmt, abort());
+    MY_ASSERT(args || len == 0, abort());
+    const char *argsEnd = args + len;
+
+    LogConversion_t conv = {};
+    const char *cur = fmt;
+    for (; nextConversion(cur, &conv); cur = conv.end) {
+        fwrite(cur, 1, (size_t) (conv.start - cur), out);
+
+        int32_t stars[MAX_STARS] = {};
+        for (int i = 0; i < conv.stars; i++)
+            if (!readArg(&args, argsEnd, &stars[i], sizeof(stars[i])))
+                return false;
+
+        // Flags, width and precision are kept, length modifier is replaced by one matching stored type
+        char spec[64] = "";
+        size_t prefixLen = (size_t) (conv.modifier - conv.start);
+        if (prefixLen + 4 > sizeof(spec))
+            return false;
+        memcpy(spec, conv.start, prefixLen);
+        const char *modifier = "";
+        if (conv.type == LOG_ARG_LONG)        modifier = "ll";
+        if (conv.type == LOG_ARG_LONG_DOUBLE) modifier = "L";
+        if (conv.type == LOG_ARG_INT && conv.conversion != 'c' && *conv.modifier == 'h')
+            modifier = (conv.modifier[1] == 'h') ? "hh" : "h";
+        snprintf(spec + prefixLen, sizeof(spec) - prefixLen, "%s%c", modifier,
+                 (conv.type == LOG_ARG_POINTER) ? 'p' : conv.conversion);
+
+        switch (conv.type) {
+            case LOG_ARG_INT: {
+                int32_t value = 0;
+                if (!readArg(&args, argsEnd, &value, sizeof(value))) return false;
+                PRINT_CONVERSION(value);
+                break;
+            }
+            case LOG_ARG_LONG: {
+                int64_t value = 0;
+                if (!readArg(&args, argsEnd, &value, sizeof(value))) return false;
+                PRINT_CONVERSION((long long) value);
+                break;
+            }
+            case LOG_ARG_DOUBLE: {
+                double value = 0;
+                if (!readArg(&args, argsEnd, &value, sizeof(value))) return false;
+                PRINT_CONVERSION(value);
+                break;
+            }
+            case LOG_ARG_LONG_DOUBLE: {
+                long double value = 0;
+                if (!readArg(&args, argsEnd, &value, sizeof(value))) return false;
+                PRINT_CONVERSION(value);
+                break;
+            }
+            case LOG_ARG_POINTER: {
+                uint64_t value = 0;
+                if (!readArg(&args, argsEnd, &value, sizeof(value))) return false;
+                // %n wrote to writer's memory, it has no text
+                if (conv.conversion != 'n')
+                    PRINT_CONVERSION((void *) value);
+                break;
+            }
+            case LOG_ARG_STRING: {
+                uint32_t strLen = 0;
+                if (!readArg(&args, argsEnd, &strLen, sizeof(strLen))) return false;
+                if (strLen == NULL_STRING) {
+                    PRINT_CONVERSION("(null)");
+                    break;
+                }
+                if ((size_t) (argsEnd - args) < strLen) return false;
+                char *str = strndup(args, strLen);
+                MY_ASSERT(str, abort());
+                args += strLen;
+                PRINT_CONVERSION(str);
+                free(str);
+                break;
+            }
+            case LOG_ARG_NONE:
+            default:
+                fputs((conv.conversion == '%') ? "%" : spec, out);
+                break;
+        }
+    }
+    fputs(cur, out);
+    return args == argsEnd;
+}
+
+#undef PRINT_CONVERSION
+#pragma GCC diagnostic pop
@@ -1,51 +1,457 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <stdarg.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <thread>
 
 #include "error_debug.h"
 #include "logger.h"
+#include "logBinary.h"
 
 static FILE *logFile = NULL;
 static const char *logFileName = "log.txt";
-static enum LogLevel globalLogLevel = L_ZERO;
+static const char *binaryLogFileName = "log.bin";
+
+enum LogLevel logSubsystemLevels[LOG_SUB_COUNT] = {};
+
+static const size_t LOG_TIME_BYTES    = 40;     // "[dd.mm.yyyy hh:mm:ss.uuuuuu] "
+static const size_t LOG_MESSAGE_BYTES = 512;    // Messages are formatted on stack if they fit
+static const size_t LOG_FILE_BUFFER   = 1 << 16;
+static const size_t LOG_KNOWN_FORMATS = 256;    // Formats remembered per thread in binary mode
+static const size_t LOG_KNOWN_PROBES  = 8;
 
+static bool binaryMode = false;
+static unsigned binarySession = 0;              // accessed atomically
 
-static struct tm getTime();
+static size_t formatTime(char *buffer, size_t size);
 static void logTime();
+static const char **findFormat(const char *fmt);
+static bool isFormatKnown(const char *fmt);
+static void rememberFormat(const char *fmt);
+static bool encodeRecord(LogRecordBuffer_t *buffer, bool withTime, const char *fmt, va_list args);
+static void writeMessage(bool withTime, const char *fmt, va_list args);
+static void filePrint(bool withTime, const char *fmt, ...) __attribute__( (format( printf, 2, 3 ) ) );
+
+/*------------------TIMESTAMPS------------------------------------------------*/
+
+/// localtime is called once per second per thread
+size_t logFormatTime(char *buffer, size_t size, const struct timespec *time) {
+    MY_ASSERT(buffer, abort());
+    MY_ASSERT(time, abort());
+    static thread_local time_t cachedSecond = -1;
+    static thread_local char cachedPrefix[LOG_TIME_BYTES] = "";
+
+    if (time->tv_sec != cachedSecond) {
+        struct tm currentTime = {};
+        localtime_r(&time->tv_sec, &currentTime);
+        snprintf(cachedPrefix, sizeof(cachedPrefix), "[%.2d.%.2d.%d %.2d:%.2d:%.2d",
+            currentTime.tm_mday, currentTime.tm_mon, currentTime.tm_year + 1900,
+            currentTime.tm_hour, currentTime.tm_min, currentTime.tm_sec);
+        cachedSecond = time->tv_sec;
+    }
+    int len = snprintf(buffer, size, "%s.%.6ld] ", cachedPrefix, time->tv_nsec / 1000);
+    return (len < 0) ? 0 : ((size_t) len < size) ? (size_t) len : size - 1;
+}
 
-static struct tm getTime() {
-    time_t currentTime = time(NULL);
-    struct tm result = *localtime(&currentTime);
-    return result;
+static size_t formatTime(char *buffer, size_t size) {
+    struct timespec now = {};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return logFormatTime(buffer, size, &now);
 }
 
 static void logTime() {
     MY_ASSERT(logFile, abort());
-    struct tm currentTime = getTime();
-    fprintf(logFile, "[%.2d.%.2d.%d %.2d:%.2d:%.2d] ",
-        currentTime.tm_mday, currentTime.tm_mon, currentTime.tm_year + 1900,
-        currentTime.tm_hour, currentTime.tm_min, currentTime.tm_sec);
+    char buffer[LOG_TIME_BYTES] = "";
+    formatTime(buffer, sizeof(buffer));
+    fputs(buffer, logFile);
+}
+
+/*------------------BINARY MODE-----------------------------------------------*/
+
+/// Slot of fmt in formats written by current thread, or empty slot for it, or NULL if table is full
+static const char **findFormat(const char *fmt) {
+    static thread_local const char *known[LOG_KNOWN_FORMATS] = {};
+    static thread_local unsigned knownSession = 0;
+
+    unsigned session = __atomic_load_n(&binarySession, __ATOMIC_ACQUIRE);
+    if (knownSession != session) {
+        memset(known, 0, sizeof(known));
+        knownSession = session;
+    }
+    size_t pos = ((uintptr_t) fmt >> 3) % LOG_KNOWN_FORMATS;
+    for (size_t i = 0; i < LOG_KNOWN_PROBES; i++, pos = (pos + 1) % LOG_KNOWN_FORMATS)
+        if (known[pos] == fmt || !known[pos])
+            return &known[pos];
+    return NULL;
+}
+
+/// Format is written before first message of every thread that uses it
+static bool isFormatKnown(const char *fmt) {
+    const char **slot = findFormat(fmt);
+    return slot && *slot == fmt;
+}
+
+/// Called when record with format reached file or ring; if table is full, format is written every time
+static void rememberFormat(const char *fmt) {
+    const char **slot = findFormat(fmt);
+    if (slot)
+        *slot = fmt;
+}
+
+/// @return true if format record is included
+static bool encodeRecord(LogRecordBuffer_t *buffer, bool withTime, const char *fmt, va_list args) {
+    struct timespec now = {};
+    if (withTime)
+        clock_gettime(CLOCK_REALTIME, &now);
+    bool newFormat = !isFormatKnown(fmt);
+    if (newFormat)
+        logEncodeFormat(buffer, fmt);
+    logEncodeMessage(buffer, withTime, now.tv_sec * 1000000000 + now.tv_nsec, fmt, args);
+    return newFormat;
+}
+
+/// Message is written by one fwrite, so records of different threads don't mix
+static void writeMessage(bool withTime, const char *fmt, va_list args) {
+    if (!binaryMode) {
+        if (withTime)
+            logTime();
+        vfprintf(logFile, fmt, args);
+        return;
+    }
+    LogRecordBuffer_t buffer = {};
+    logRecordBufferInit(&buffer);
+    if (encodeRecord(&buffer, withTime, fmt, args))
+        rememberFormat(fmt);
+    fwrite(buffer.data, 1, buffer.size, logFile);
+    logRecordBufferFree(&buffer);
+}
+
+static void filePrint(bool withTime, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    writeMessage(withTime, fmt, args);
+    va_end(args);
+}
+
+/*------------------ASYNC MODE------------------------------------------------*/
+
+/// @brief Byte ring of one thread: owner writes messages, writer thread writes them to file
+typedef struct logRing {
+    char *buffer;
+    size_t capacity;
+    size_t head;                                ///< Bytes put by owner (accessed atomically)
+    size_t tail;                                ///< Bytes written to file (accessed atomically)
+    size_t dropped;                             ///< Messages dropped since last report (accessed atomically)
+    bool closed;                                ///< Owner thread has exited (accessed atomically)
+    struct logRing *next;                       ///< Next ring, rings are removed only by writer thread
+} logRing_t;
+
+/// @brief Ring of current thread, marked closed when thread exits
+struct LogRingOwner {
+    logRing_t *ring;
+    unsigned generation;                        ///< Ring of other generation is already freed
+
+    LogRingOwner() : ring(NULL), generation(0) {}
+    LogRingOwner(const LogRingOwner &) = delete;
+    LogRingOwner &operator=(const LogRingOwner &) = delete;
+    ~LogRingOwner();
+};
+
+static thread_local LogRingOwner ringOwner;
+
+static logRing_t *ringList = NULL;              // accessed atomically
+static bool asyncMode = false;                  // accessed atomically
+static bool writerStop = false;                 // accessed atomically
+static bool writerPause = false;                // accessed atomically, set by abort handler
+static bool writerPaused = false;               // accessed atomically
+static size_t writerPasses = 0;                 // accessed atomically
+static unsigned asyncGeneration = 0;            // accessed atomically
+static enum LogOverflowPolicy overflowPolicy = LOG_OVERFLOW_BLOCK;
+static size_t asyncRingBytes = LOG_RING_DEFAULT_BYTES;
+static std::thread *writerThread = NULL;
+static struct sigaction oldAbortAction = {};
+
+static logRing_t *getRing();
+static bool ringPut(logRing_t *ring, const char *msg, size_t len);
+static size_t ringDrain(logRing_t *ring);
+static void freeRing(logRing_t *ring);
+static void writerLoop();
+static void abortHandler(int sig);
+static void asyncPrint(bool withTime, const char *fmt, va_list args);
+static void stopAsyncAtExit();
+
+LogRingOwner::~LogRingOwner() {
+    if (ring && generation == __atomic_load_n(&asyncGeneration, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&asyncMode, __ATOMIC_ACQUIRE))
+        __atomic_store_n(&ring->closed, true, __ATOMIC_RELEASE);
+}
+
+static logRing_t *getRing() {
+    unsigned generation = __atomic_load_n(&asyncGeneration, __ATOMIC_ACQUIRE);
+    if (ringOwner.ring && ringOwner.generation == generation)
+        return ringOwner.ring;
+
+    logRing_t *ring = (logRing_t *) calloc(1, sizeof(logRing_t));
+    MY_ASSERT(ring, abort());
+    ring->buffer = (char *) malloc(asyncRingBytes);
+    MY_ASSERT(ring->buffer, abort());
+    ring->capacity = asyncRingBytes;
+    ring->next = __atomic_load_n(&ringList, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&ringList, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    ringOwner.ring = ring;
+    ringOwner.generation = generation;
+    return ring;
+}
+
+/// Message is published at once, so writer never sees half of it
+/// @return false if message was dropped
+static bool ringPut(logRing_t *ring, const char *msg, size_t len) {
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    // Message is dropped whole, binary records can't be cut
+    if (overflowPolicy != LOG_OVERFLOW_BLOCK &&
+        head + len - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->capacity) {
+        if (overflowPolicy == LOG_OVERFLOW_COUNT)
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    // Message longer than ring is put in parts
+    while (len > 0) {
+        size_t part = (len < ring->capacity) ? len : ring->capacity;
+        while (head + part - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->capacity)
+            std::this_thread::yield();
+        size_t pos = head % ring->capacity;
+        size_t first = (part < ring->capacity - pos) ? part : ring->capacity - pos;
+        memcpy(ring->buffer + pos, msg, first);
+        memcpy(ring->buffer, msg + first, part - first);
+        head += part;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+        msg += part;
+        len -= part;
+    }
+    return true;
+}
+
+/// Write everything owner has put, return number of bytes
+static size_t ringDrain(logRing_t *ring) {
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t len = head - tail;
+    if (len) {
+        size_t pos = tail % ring->capacity;
+        size_t first = (len < ring->capacity - pos) ? len : ring->capacity - pos;
+        fwrite(ring->buffer + pos, 1, first, logFile);
+        fwrite(ring->buffer, 1, len - first, logFile);
+        __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    }
+    size_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    if (dropped)
+        filePrint(false, "[%zu log messages dropped]\n", dropped);
+    return len + dropped;
+}
+
+static void freeRing(logRing_t *ring) {
+    free(ring->buffer);
+    free(ring);
+}
+
+static void writerLoop() {
+    while (true) {
+        if (__atomic_load_n(&writerPause, __ATOMIC_ACQUIRE)) {
+            // Abort handler writes rings itself
+            __atomic_store_n(&writerPaused, true, __ATOMIC_RELEASE);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        bool stop = __atomic_load_n(&writerStop, __ATOMIC_ACQUIRE);
+        size_t written = 0;
+
+        logRing_t *prev = NULL;
+        logRing_t *ring = __atomic_load_n(&ringList, __ATOMIC_ACQUIRE);
+        while (ring) {
+            bool closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+            written += ringDrain(ring);
+            logRing_t *next = ring->next;
+            // Threads only push new rings to list head, so only removal of head needs CAS
+            if (closed) {
+                logRing_t *expected = ring;
+                if (prev) {
+                    prev->next = next;
+                    freeRing(ring);
+                    ring = prev;
+                } else if (__atomic_compare_exchange_n(&ringList, &expected, next, false,
+                                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                    freeRing(ring);
+                    ring = NULL;
+                }
+            }
+            prev = ring;
+            ring = next;
+        }
+        if (written)
+            fflush(logFile);
+        __atomic_add_fetch(&writerPasses, 1, __ATOMIC_RELEASE);
+
+        if (stop && written == 0)
+            return;
+        if (written == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/// Messages of crashed program are the most important ones
+static void abortHandler(int sig) {
+    __atomic_store_n(&writerPause, true, __ATOMIC_RELEASE);
+    // Writer may be the thread that aborted, so it isn't waited forever
+    for (int i = 0; i < 1000 && !__atomic_load_n(&writerPaused, __ATOMIC_ACQUIRE); i++)
+        usleep(1000);
+    for (logRing_t *ring = __atomic_load_n(&ringList, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+        ringDrain(ring);
+    fflush(logFile);
+    // abort() raises signal again after handler returns
+    sigaction(sig, &oldAbortAction, NULL);
+}
+
+static void asyncPrint(bool withTime, const char *fmt, va_list args) {
+    if (binaryMode) {
+        LogRecordBuffer_t buffer = {};
+        logRecordBufferInit(&buffer);
+        bool newFormat = encodeRecord(&buffer, withTime, fmt, args);
+        if (ringPut(getRing(), buffer.data, buffer.size) && newFormat)
+            rememberFormat(fmt);
+        logRecordBufferFree(&buffer);
+        return;
+    }
+    char local[LOG_MESSAGE_BYTES] = "";
+    size_t prefix = (withTime) ? formatTime(local, sizeof(local)) : 0;
+
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int len = vsnprintf(local + prefix, sizeof(local) - prefix, fmt, argsCopy);
+    va_end(argsCopy);
+    if (len < 0)
+        return;
+
+    if (prefix + (size_t) len < sizeof(local)) {
+        ringPut(getRing(), local, prefix + (size_t) len);
+        return;
+    }
+    char *message = (char *) malloc(prefix + (size_t) len + 1);
+    MY_ASSERT(message, abort());
+    memcpy(message, local, prefix);
+    vsnprintf(message + prefix, (size_t) len + 1, fmt, args);
+    ringPut(getRing(), message, prefix + (size_t) len);
+    free(message);
+}
+
+enum status logStartAsync(enum LogOverflowPolicy policy, size_t ringBytes) {
+    MY_ASSERT(logFile, abort());
+    MY_ASSERT(ringBytes > 0, abort());
+    if (__atomic_load_n(&asyncMode, __ATOMIC_ACQUIRE))
+        return ERROR;
+
+    overflowPolicy = policy;
+    asyncRingBytes = ringBytes;
+    __atomic_add_fetch(&asyncGeneration, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&writerStop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&writerPause, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&writerPaused, false, __ATOMIC_RELAXED);
+    setvbuf(logFile, NULL, _IOFBF, LOG_FILE_BUFFER);
+
+    struct sigaction action = {};
+    action.sa_handler = abortHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGABRT, &action, &oldAbortAction);
+
+    static bool exitHandlerSet = false;
+    if (!exitHandlerSet)
+        exitHandlerSet = (atexit(stopAsyncAtExit) == 0);
+
+    writerThread = new std::thread(writerLoop);
+    __atomic_store_n(&asyncMode, true, __ATOMIC_RELEASE);
+    return SUCCESS;
+}
+
+/// No thread may log while async mode is being stopped
+enum status logStopAsync() {
+    if (!__atomic_load_n(&asyncMode, __ATOMIC_ACQUIRE))
+        return ERROR;
+    __atomic_store_n(&asyncMode, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&writerStop, true, __ATOMIC_RELEASE);
+    writerThread->join();
+    delete writerThread;
+    writerThread = NULL;
+    sigaction(SIGABRT, &oldAbortAction, NULL);
+
+    logRing_t *ring = __atomic_exchange_n(&ringList, NULL, __ATOMIC_ACQ_REL);
+    while (ring) {
+        logRing_t *next = ring->next;
+        ringDrain(ring);
+        freeRing(ring);
+        ring = next;
+    }
+    fflush(logFile);
+    setvbuf(logFile, NULL, _IONBF, 0);
+    return SUCCESS;
 }
 
+/// Program may exit without logClose
+static void stopAsyncAtExit() {
+    logStopAsync();
+}
+
+void logFlush() {
+    if (!__atomic_load_n(&asyncMode, __ATOMIC_ACQUIRE))
+        return;
+    // Second pass is started after this call, so it sees everything logged before it
+    size_t target = __atomic_load_n(&writerPasses, __ATOMIC_ACQUIRE) + 2;
+    while (__atomic_load_n(&writerPasses, __ATOMIC_ACQUIRE) < target)
+        std::this_thread::yield();
+}
+
+/*------------------LOG FILE--------------------------------------------------*/
+
 enum status logOpen() {
     logFile = fopen(logFileName, "a");
     if (!logFile) return ERROR;
     setbuf(logFile, NULL); //disabling buffering
+    binaryMode = false;
 
-    fprintf(logFile, "------------------------------------------\n");
-    logTime();
-    fprintf(logFile, "Starting logging session\n");
+    filePrint(false, "------------------------------------------\n");
+    filePrint(true, "Starting logging session\n");
     return SUCCESS;
 }
 
-enum status logClose() {
+enum status logOpenBinary() {
+    logFile = fopen(binaryLogFileName, "ab");
     if (!logFile) return ERROR;
+    setbuf(logFile, NULL); //disabling buffering
+    binaryMode = true;
+    __atomic_add_fetch(&binarySession, 1, __ATOMIC_RELEASE);
 
+    struct timespec now = {};
+    clock_gettime(CLOCK_REALTIME, &now);
+    LogRecordBuffer_t buffer = {};
+    logRecordBufferInit(&buffer);
+    logEncodeSession(&buffer, now.tv_sec * 1000000000 + now.tv_nsec);
+    fwrite(buffer.data, 1, buffer.size, logFile);
+    logRecordBufferFree(&buffer);
 
-    logTime();
-    fprintf(logFile, "Ending logging session \n");
-    fprintf(logFile, "-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*\n");
+    filePrint(false, "------------------------------------------\n");
+    filePrint(true, "Starting logging session\n");
+    return SUCCESS;
+}
+
+enum status logClose() {
+    if (!logFile) return ERROR;
+    logStopAsync();
+
+    filePrint(true, "Ending logging session \n");
+    filePrint(false, "-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*\n");
 
     fclose(logFile);
 
@@ -53,43 +459,51 @@ enum status logClose() {
 }
 
 void setLogLevel(enum LogLevel level) {
-    globalLogLevel = level;
+    for (size_t i = 0; i < LOG_SUB_COUNT; i++)
+        logSubsystemLevels[i] = level;
 }
 
-enum status logPrintWithTime(enum LogLevel level, bool copyToStderr, const char* fmt, ...) {
+void setLogSubsystemLevel(enum LogSubsystem subsystem, enum LogLevel level) {
+    MY_ASSERT(subsystem < LOG_SUB_COUNT, abort());
+    logSubsystemLevels[subsystem] = level;
+}
+
+enum status logPrintWithTimeBase(bool copyToStderr, const char* fmt, ...) {
     MY_ASSERT(logFile, abort());
-    if (level > globalLogLevel)
-        return SUCCESS;
 
     va_list args;
 
     if (copyToStderr) {
         va_start(args, fmt);
         vfprintf(stderr, fmt, args);
+        va_end(args);
     }
     va_start(args, fmt);
-    logTime();
-    vfprintf(logFile, fmt, args);
+    if (__atomic_load_n(&asyncMode, __ATOMIC_ACQUIRE))
+        asyncPrint(true, fmt, args);
+    else
+        writeMessage(true, fmt, args);
 
     va_end(args);
     return SUCCESS;
 }
 
-enum status logPrint(enum LogLevel level, bool copyToStderr, const char* fmt, ...) {
+enum status logPrintBase(bool copyToStderr, const char* fmt, ...) {
     MY_ASSERT(logFile, abort());
-    if (level > globalLogLevel)
-        return SUCCESS;
 
     va_list args;
 
     if (copyToStderr) {
         va_start(args, fmt);
         vfprintf(stderr, fmt, args);
+        va_end(args);
     }
     va_start(args, fmt);
-    vfprintf(logFile, fmt, args);
+    if (__atomic_load_n(&asyncMode, __ATOMIC_ACQUIRE))
+        asyncPrint(false, fmt, args);
+    else
+        writeMessage(false, fmt, args);
 
     va_end(args);
     return SUCCESS;
 }
-
@@ -1,28 +1,75 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #include "error_debug.h"
 #include "logger.h"
 #include "cStack.h"
+#include "tStack.h"
+#include "lfStack.h"
+#include "elimStack.h"
+#include "segStack.h"
+#include "stackSnapshot.h"
 #include "argvProcessor.h"
 
 void test1();
 void test2();
+void test3();
+void test4();
+void test5();
+void test6();
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
 
 int main(int argc, const char *argv[]) {
     logOpen();
     setLogLevel(L_EXTRA);
 
     registerFlag(TYPE_BLANK, "-r", "--remove", "Delete old log file");
+    registerFlag(TYPE_BLANK, "-a", "--async", "Write log from background thread");
+    registerFlag(TYPE_BLANK, "-b", "--binary", "Write binary log.bin instead of log.txt (see tools/logDecode)");
     processArgs(argc, argv);
     if (isFlagSet("-r")) {
         system("rm log.txt");
         logOpen();
     }
+    if (isFlagSet("-b")) {
+        logClose();
+        logOpenBinary();
+    }
+    if (isFlagSet("-a"))
+        logStartAsync(LOG_OVERFLOW_BLOCK, LOG_RING_DEFAULT_BYTES);
 
     test1();
     test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
     logClose();
 }
 
@@ -58,3 +105,505 @@ void test2() {
         stackDtor(&stks[i]);
     free(stks);
 }
+
+void test3() {
+    const size_t batchSize = 1000;
+    stkElem_t *batch = (stkElem_t*) calloc(batchSize, sizeof(stkElem_t));
+    for (size_t i = 0; i < batchSize; i++)
+        batch[i] = (stkElem_t) i;
+
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    stackReserve(&stk, 2 * batchSize);
+    stackPushN(&stk, batch, batchSize);
+    stackPushN(&stk, batch, batchSize);
+    stackPopN(&stk, batch, batchSize);
+    for (size_t i = 0; i < batchSize; i++)
+        MY_ASSERT(batch[i] == (stkElem_t) i, abort());
+    stackPopN(&stk, NULL, batchSize - 10);
+    MY_ASSERT(stackGetSize(&stk) == 10 && stackTop(&stk) == 9, abort());
+    stackDump(&stk);
+    logPrint(L_ZERO, 1, "Batch: %d, top: %d\n", batch[batchSize-1], stackTop(&stk));
+
+    // Source inside full stack is read from new block after reallocation
+    while (stackGetSize(&stk) < stk.capacity)
+        stackPush(&stk, (stkElem_t) (stackGetSize(&stk) % batchSize));
+    size_t full = stackGetSize(&stk);
+    stackPushN(&stk, stk.data, full);
+    MY_ASSERT(stackGetSize(&stk) == 2 * full && stk.capacity > full, abort());
+    for (size_t i = 0; i < full; i++)
+        MY_ASSERT(stk.data[full + i] == stk.data[i], abort());
+    stackDtor(&stk);
+
+    // Oscillating around shrink border: no realloc with delay
+    StackCapacityPolicy_t lazyShrink = STACK_DEFAULT_POLICY;
+    lazyShrink.shrinkDelay = 16;
+    stackCtor(&stk, 64);
+    stackSetCapacityPolicy(&stk, &lazyShrink);
+    size_t capacity = stk.capacity;
+    // Stack is underused after pop and back to normal after push
+    for (size_t i = 0; i < capacity / lazyShrink.shrinkRatio; i++)
+        stackPush(&stk, (stkElem_t) i);
+    stackResetStats(&stk);
+    for (size_t i = 0; i < batchSize; i++) {
+        stackPop(&stk);
+        stackPush(&stk, (stkElem_t) i);
+    }
+    MY_ASSERT(stk.capacity == capacity, abort());
+    ON_METRICS(MY_ASSERT(stackGetStats(&stk).grows == 0 && stackGetStats(&stk).shrinks == 0, abort());)
+    stackShrinkToFit(&stk);
+    logPrint(L_ZERO, 1, "Oscillating stack capacity: %zu\n", stk.capacity);
+    stackDtor(&stk);
+    free(batch);
+}
+
+void test4() {
+    Stack<double> dstk(4);
+    for (int i = 0; i < 100; i++)
+        dstk.push(i + 0.1235);
+    for (int i = 0; i < 90; i++)
+        dstk.pop();
+    dstk.dump();
+    logPrint(L_ZERO, 1, "Double top: %g\n", dstk.top());
+
+    Stack<const char *> strStk;
+    strStk.emplace("first");
+    strStk.push("second");
+    logPrint(L_ZERO, 1, "String top: %s\n", strStk.pop());
+
+    // Arguments pointing into stack survive reallocation
+    Stack<long> alias;
+    alias.push(0);
+    while (alias.getSize() < alias.getCapacity())
+        alias.push(alias.top() + 1);
+    size_t size = alias.getSize();
+    alias.push(alias.top());
+    MY_ASSERT(alias.getCapacity() > size && alias.top() == (long) size - 1, abort());
+    size = alias.getSize();
+    const long *first = &alias.top() - (size - 1);
+    alias.pushN(first, size);
+    MY_ASSERT(alias.getSize() == 2 * size && alias.pop() == (long) size - 2, abort());
+}
+
+void test5() {
+    const int pushesCount = 1000, popsCount = 500, secondBase = 10000;
+    LfStack_t stk = {};
+    lfStackCtor(&stk);
+    // Every element is counted once when popped by workers and once when stack is emptied
+    size_t *popCounts = (size_t *) calloc(secondBase + pushesCount, sizeof(size_t));
+    MY_ASSERT(popCounts, abort());
+    auto worker = [&stk, popCounts](int base) {
+        stkElem_t val = 0;
+        for (int i = 0; i < pushesCount; i++)
+            lfStackPush(&stk, base + i);
+        for (int i = 0; i < popsCount; i++) {
+            StackError_t err = lfStackPop(&stk, &val);
+            MY_ASSERT(err == STACK_OK && val >= 0 && val < secondBase + pushesCount, abort());
+            __atomic_add_fetch(&popCounts[val], 1, __ATOMIC_RELAXED);
+        }
+    };
+    std::thread first(worker, 0), second(worker, secondBase);
+    first.join();
+    second.join();
+
+    size_t size = lfStackGetSize(&stk);
+    stkElem_t top = 0;
+    StackError_t err = lfStackTop(&stk, &top);
+    MY_ASSERT(size == 2 * (pushesCount - popsCount) && err == STACK_OK, abort());
+    logPrint(L_ZERO, 1, "Lock-free size: %zu, top %d\n", size, top);
+    stkElem_t left = 0;
+    while (lfStackPop(&stk, &left) == STACK_OK)
+        popCounts[left]++;
+    for (int i = 0; i < pushesCount; i++)
+        MY_ASSERT(popCounts[i] == 1 && popCounts[secondBase + i] == 1, abort());
+    MY_ASSERT(lfStackGetSize(&stk) == 0, abort());
+    lfStackDtor(&stk);
+
+    // One slot, so every pop looks at offered push
+    ElimStack_t elimStk = {};
+    elimStackCtor(&elimStk, 1, 0);
+    elimStackSetEliminateFirst(&elimStk, true);
+    memset(popCounts, 0, (secondBase + pushesCount) * sizeof(size_t));
+    auto elimWorker = [&elimStk, popCounts](int base) {
+        stkElem_t val = 0;
+        for (int i = 0; i < pushesCount; i++) {
+            elimStackPush(&elimStk, base + i);
+            StackError_t popErr = elimStackPop(&elimStk, &val);
+            MY_ASSERT(popErr == STACK_OK && val >= 0 && val < secondBase + pushesCount, abort());
+            __atomic_add_fetch(&popCounts[val], 1, __ATOMIC_RELAXED);
+        }
+    };
+    std::thread third(elimWorker, 0), fourth(elimWorker, secondBase);
+    third.join();
+    fourth.join();
+
+    ElimStackStats_t stats = elimStackGetStats(&elimStk);
+    logPrint(L_ZERO, 1, "Elimination: %zu central, %zu eliminated pushes\n",
+             stats.centralPushes, stats.eliminatedPushes);
+    MY_ASSERT(stats.eliminatedPushes > 0 && stats.eliminatedPushes == stats.eliminatedPops, abort());
+    MY_ASSERT(stats.centralPushes + stats.eliminatedPushes == 2 * (size_t) pushesCount, abort());
+    for (int i = 0; i < pushesCount; i++)
+        MY_ASSERT(popCounts[i] == 1 && popCounts[secondBase + i] == 1, abort());
+    MY_ASSERT(elimStackGetSize(&elimStk) == 0 && elimStackPop(&elimStk, &left) == ERR_EMPTY, abort());
+    elimStackDtor(&elimStk);
+    free(popCounts);
+}
+
+void test6() {
+    SegStack_t stk = {};
+    segStackCtor(&stk, NULL);
+    for (int i = 0; i < 3000; i++)
+        segStackPush(&stk, i);
+    stkElem_t *elem = segStackTop(&stk);
+    for (int i = 0; i < 3000; i++)
+        segStackPush(&stk, i);
+    // Elements are never moved
+    MY_ASSERT(*elem == 2999, abort());
+
+    // Push/pop at chunk border uses spare chunk
+    while (segStackGetSize(&stk) > SEG_CHUNK_ELEMS + 1)
+        segStackPop(&stk);
+    for (int i = 0; i < 100; i++) {
+        segStackPop(&stk);
+        segStackPush(&stk, i);
+    }
+    logPrint(L_ZERO, 1, "Segmented: %zu elements in %zu chunks, top %d\n",
+             segStackGetSize(&stk), stk.chunksCount, *segStackTop(&stk));
+    StackError_t err = segStackVerify(&stk);
+    MY_ASSERT(err == STACK_OK, abort());
+    segStackDtor(&stk);
+}
+
+void test7() {
+    const char *path = "mappedStack.bin";
+    remove(path);
+    Stack_t stk = {};
+    StackError_t err = stackCtorMapped(&stk, path);
+    MY_ASSERT(err == STACK_OK, abort());
+    for (int i = 0; i < 1000; i++)
+        stackPush(&stk, i);
+    stackCloseMapped(&stk);
+
+    // Reopened stack is ready without reloading
+    err = stackCtorMapped(&stk, path);
+    MY_ASSERT(err == STACK_OK, abort());
+    logPrint(L_ZERO, 1, "Mapped: %zu elements, top %d\n", stackGetSize(&stk), stackTop(&stk));
+    for (int i = 0; i < 900; i++)
+        stackPop(&stk);
+    stackDump(&stk);
+    stackDtor(&stk);
+    remove(path);
+}
+
+void test8() {
+    const char *path = "stackSnapshot.bin";
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    // Bigger than one checksum block
+    const size_t count = 300000;
+    stkElem_t *elems = (stkElem_t *) calloc(count, sizeof(stkElem_t));
+    MY_ASSERT(elems, abort());
+    for (size_t i = 0; i < count; i++)
+        elems[i] = (stkElem_t) i;
+    stackPushN(&stk, elems, count);
+    free(elems);
+
+    // Two snapshots in one file
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    MY_ASSERT(fd >= 0, abort());
+    StackError_t err = stackSave(&stk, fd);
+    MY_ASSERT(err == STACK_OK, abort());
+    stackPopN(&stk, NULL, 299990);
+    err = stackSave(&stk, fd);
+    MY_ASSERT(err == STACK_OK, abort());
+    stackDtor(&stk);
+
+    stackCtor(&stk, 0);
+    lseek(fd, 0, SEEK_SET);
+    err = stackLoad(&stk, fd) | stackLoad(&stk, fd);
+    MY_ASSERT(err == STACK_OK, abort());
+    logPrint(L_ZERO, 1, "Snapshots: %zu elements, top %d\n", stackGetSize(&stk), stackTop(&stk));
+
+    // Broken element is caught and stack is left unchanged
+    int broken = -1;
+    pwrite(fd, &broken, sizeof(broken), sizeof(StackSnapshotHeader_t) + 1000 * sizeof(stkElem_t));
+    lseek(fd, 0, SEEK_SET);
+    err = stackLoad(&stk, fd);
+    MY_ASSERT(err == ERR_HASH_DATA && stackGetSize(&stk) == 300010, abort());
+    stackDtor(&stk);
+    close(fd);
+    remove(path);
+}
+
+void test9() {
+    const char *path = "stackCheckpoints.bin";
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    const size_t count = 300000;
+    stkElem_t *elems = (stkElem_t *) calloc(count, sizeof(stkElem_t));
+    MY_ASSERT(elems, abort());
+    for (size_t i = 0; i < count; i++)
+        elems[i] = (stkElem_t) i;
+    stackPushN(&stk, elems, count);
+
+    // Base snapshot, then two checkpoints that write only top of stack
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    MY_ASSERT(fd >= 0, abort());
+    StackError_t err = stackSave(&stk, fd);
+    off_t baseBytes = lseek(fd, 0, SEEK_CUR);
+    stackPopN(&stk, NULL, 100);
+    stackPushN(&stk, elems, 50);
+    err |= stackSaveDelta(&stk, fd);
+    stackPopN(&stk, NULL, 10);
+    stackPush(&stk, -1);
+    off_t delta1End = lseek(fd, 0, SEEK_CUR);
+    err |= stackSaveDelta(&stk, fd);
+    MY_ASSERT(err == STACK_OK, abort());
+    logPrint(L_ZERO, 1, "Checkpoints: base %lld bytes, deltas %lld bytes\n",
+             (long long) baseBytes, (long long) (lseek(fd, 0, SEEK_CUR) - baseBytes));
+    size_t size = stackGetSize(&stk);
+    stackDtor(&stk);
+
+    // Delta can't be applied before its base
+    stackCtor(&stk, 0);
+    lseek(fd, delta1End, SEEK_SET);
+    err = stackLoad(&stk, fd);
+    MY_ASSERT(err == ERR_HASH_STACK, abort());
+
+    lseek(fd, 0, SEEK_SET);
+    err = stackLoad(&stk, fd) | stackLoad(&stk, fd) | stackLoad(&stk, fd);
+    MY_ASSERT(err == STACK_OK && stackGetSize(&stk) == size && stackTop(&stk) == -1, abort());
+    stackPop(&stk);
+    MY_ASSERT(stackTop(&stk) == 39, abort());
+    logPrint(L_ZERO, 1, "Restored from checkpoints: %zu elements\n", size);
+    stackDtor(&stk);
+    free(elems);
+    close(fd);
+    remove(path);
+}
+
+void test10() {
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    for (int i = 0; i < 10; i++)
+        stackPush(&stk, i);
+    MY_ASSERT(stk.capacity == STACK_INLINE_CAPACITY || STACK_INLINE_CAPACITY == 0, abort());
+    stackDump(&stk);
+
+    // Spills to allocated block and comes back when it is underused
+    for (int i = 10; i < 40; i++)
+        stackPush(&stk, i);
+    for (int i = 0; i < 35; i++)
+        stackPop(&stk);
+    stackPush(&stk, 5);
+    stackDump(&stk);
+    logPrint(L_ZERO, 1, "Inline: %zu elements, capacity %zu, top %d\n", stackGetSize(&stk), stk.capacity, stackTop(&stk));
+    stackDtor(&stk);
+}
+
+void test11() {
+    const char *path = "stackDump.bin";
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    const size_t count = 1000000;
+    stkElem_t *elems = (stkElem_t *) calloc(count, sizeof(stkElem_t));
+    MY_ASSERT(elems, abort());
+    for (size_t i = 0; i < count; i++)
+        elems[i] = (stkElem_t) (i / 1000);
+    stackPushN(&stk, elems, count);
+    stackPopN(&stk, NULL, 1500);
+    free(elems);
+
+    // Few lines in log, every element in raw file
+    StackDumpOptions_t options = {4, 4, true, path};
+    stackDumpWithOptions(&stk, &options);
+    FILE *raw = fopen(path, "rb");
+    MY_ASSERT(raw, abort());
+    fseek(raw, 0, SEEK_END);
+    long rawBytes = ftell(raw);
+    fclose(raw);
+    MY_ASSERT((size_t) rawBytes == stackGetSize(&stk) * sizeof(stkElem_t), abort());
+    logPrint(L_ZERO, 1, "Bounded dump: %zu elements, %ld bytes in raw file\n", stackGetSize(&stk), rawBytes);
+    stackDtor(&stk);
+    remove(path);
+}
+
+void test12() {
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    for (int i = 0; i < 1000; i++)
+        stackPush(&stk, i);
+    for (int i = 0; i < 900; i++)
+        stackPop(&stk);
+    stackVerify(&stk);
+
+    // All zero without STACK_METRICS
+    StackStats_t stats = stackGetStats(&stk);
+    ON_METRICS(MY_ASSERT(stats.pushes == 1000 && stats.pops == 900 && stats.peakSize == 1000, abort());)
+    logPrint(L_ZERO, 1, "Stats: %zu pushes, %zu pops, %zu grows, %zu shrinks, %zu bytes copied, "
+                        "verify %.3f ms, hash %.3f ms\n", stats.pushes, stats.pops, stats.grows, stats.shrinks,
+                        stats.bytesCopied, (double) stats.verifyNs / 1e6, (double) stats.hashNs / 1e6);
+    stackResetStats(&stk);
+    stackDump(&stk);
+    stackDtor(&stk);
+}
+
+static const int GUARD_FAULT_EXIT = 42;
+
+static void guardFaultHandler(int sig) {
+    (void) sig;
+    _exit(GUARD_FAULT_EXIT);
+}
+
+void test13() {
+    Stack_t stk = {};
+    stackCtorAlloc(&stk, 0, &STACK_GUARD_ALLOCATOR);
+    // Data pages are remapped many times on the way, full checks are left for the end
+    stackSetVerifyLevel(&stk, VERIFY_CANARY, 0);
+    for (int i = 0; i < 20000; i++)
+        stackPush(&stk, i);
+    for (int i = 0; i < 19000; i++)
+        stackPop(&stk);
+    MY_ASSERT(stackVerify(&stk) == STACK_OK && stackTop(&stk) == 999, abort());
+
+    // Child runs past data block until guard page stops it
+    pid_t child = fork();
+    MY_ASSERT(child >= 0, abort());
+    if (child == 0) {
+        struct sigaction action = {};
+        action.sa_handler = guardFaultHandler;
+        sigaction(SIGSEGV, &action, NULL);
+        volatile stkElem_t *data = stk.data;
+        for (size_t i = stk.capacity; ; i++)
+            data[i] = 0;
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    MY_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == GUARD_FAULT_EXIT, abort());
+
+    for (int i = 0; i < 900; i++)
+        stackPop(&stk);
+    logPrint(L_ZERO, 1, "Guard pages: overrun faulted, %zu elements left, top %d\n", stackGetSize(&stk), stackTop(&stk));
+    stackDtor(&stk);
+
+    // Block at leading guard page keeps its place while mapping grows and shrinks
+    stackCtorAlloc(&stk, 0, &STACK_GUARD_BELOW_ALLOCATOR);
+    stackSetVerifyLevel(&stk, VERIFY_CANARY, 0);
+    for (int i = 0; i < 20000; i++)
+        stackPush(&stk, i);
+    for (int i = 0; i < 19990; i++)
+        stackPop(&stk);
+    MY_ASSERT(stackVerify(&stk) == STACK_OK && stackTop(&stk) == 9, abort());
+    stackDtor(&stk);
+}
+
+static void scrubCallback(Stack_t *stk, StackError_t err, void *ctx) {
+    logPrint(L_ZERO, 1, "Scrubber callback: Stack_t[%p] %s\n", stk, stackFirstErrorToStr(err));
+    __atomic_store_n((Stack_t **) ctx, stk, __ATOMIC_RELEASE);
+}
+
+void test14() {
+    const size_t stacksCount = 8;
+    Stack_t stks[stacksCount] = {};
+    for (size_t i = 0; i < stacksCount; i++)
+        stackCtor(&stks[i], 0);
+    Stack_t *broken = NULL;
+    stackScrubStart(0, scrubCallback, &broken);
+
+    // Scrubber checks stacks while they are changed and grow, without false alarms
+    for (int round = 0; round < 200; round++)
+        for (size_t i = 0; i < stacksCount; i++) {
+            for (int j = 0; j < 50; j++)
+                stackPush(&stks[i], j);
+            stackPopN(&stks[i], NULL, (round % 2) ? 50 : 40);
+        }
+    MY_ASSERT(__atomic_load_n(&broken, __ATOMIC_ACQUIRE) == NULL, abort());
+
+    // Corruption that inline checks don't look for is found by scrubber
+    Stack_t *victim = &stks[stacksCount / 2];
+    stackSetVerifyLevel(victim, VERIFY_OFF, 0);
+    size_t size = victim->size;
+    victim->size = victim->capacity + 1;
+    for (int i = 0; i < 5000 && !__atomic_load_n(&broken, __ATOMIC_ACQUIRE); i++)
+        usleep(1000);
+    stackScrubStop();
+    MY_ASSERT(broken == victim, abort());
+    victim->size = size;
+
+    StackScrubStats_t stats = stackScrubGetStats();
+    logPrint(L_ZERO, 1, "Scrubber: %zu of %zu stacks registered, %zu passes, %zu checked, %zu busy, %zu errors\n",
+                        stacksCount, stackRegistryCount(), stats.passes, stats.checked, stats.busy, stats.errors);
+    for (size_t i = 0; i < stacksCount; i++)
+        stackDtor(&stks[i]);
+}
+
+void test15() {
+    Stack_t small = {}, full = {}, reserved = {};
+    stackCtor(&small, 0);
+    stackCtor(&full, 0);
+    stackCtor(&reserved, 0);
+    for (int i = 0; i < 10; i++)
+        stackPush(&small, i);
+    for (int i = 0; i < 1024; i++)
+        stackPush(&full, i);
+    stackReserve(&reserved, 100000);
+    for (int i = 0; i < 10; i++)
+        stackPush(&reserved, i);
+
+    StackMemory_t total = stackRegistryMemory();
+    MY_ASSERT(total.stacks == 3, abort());
+    MY_ASSERT(total.usedBytes == stackGetMemory(&small).usedBytes + stackGetMemory(&full).usedBytes +
+                                 stackGetMemory(&reserved).usedBytes, abort());
+    stackDumpAll();
+
+    // Stack marked "trim" gives its memory back
+    stackShrinkToFit(&reserved);
+    StackMemory_t trimmed = stackRegistryMemory();
+    logPrint(L_ZERO, 1, "Registry: %zu stacks, %zu bytes used, %zu -> %zu bytes in blocks after trim\n",
+                        trimmed.stacks, trimmed.usedBytes, total.blockBytes, trimmed.blockBytes);
+    stackDtor(&small);
+    stackDtor(&full);
+    stackDtor(&reserved);
+}
+
+/// Push opsCount elements, after every push check stack with bottom element changed behind its back
+/// @return number of failed checks
+static size_t countCheckErrors(Stack_t *stk, enum StackVerifyLevel level, size_t samplePeriod, size_t opsCount) {
+    stackSetVerifyLevel(stk, level, samplePeriod);
+    size_t errors = 0;
+    for (size_t i = 0; i < opsCount; i++) {
+        stackPush(stk, (stkElem_t) i);
+        stkElem_t saved = stk->data[0];
+        stk->data[0] = saved + 1;
+        if (stackCheck(stk) != STACK_OK)
+            errors++;
+        stk->data[0] = saved;
+    }
+    return errors;
+}
+
+void test16() {
+    Stack_t stk = {};
+    stackCtor(&stk, 0);
+    for (int i = 0; i < 100; i++)
+        stackPush(&stk, i);
+
+    // Only hashes see changed element, so cheap levels let it pass; sampled level
+    // checks fully after every 4th push, however many checks push does itself
+    size_t offErrors     = countCheckErrors(&stk, VERIFY_OFF,     0, 8);
+    size_t canaryErrors  = countCheckErrors(&stk, VERIFY_CANARY,  0, 8);
+    size_t sampledErrors = countCheckErrors(&stk, VERIFY_SAMPLED, 4, 8);
+    size_t fullErrors    = countCheckErrors(&stk, VERIFY_FULL,    0, 8);
+    MY_ASSERT(offErrors == 0 && canaryErrors == 0, abort());
+    ON_HASH(MY_ASSERT(sampledErrors == 2 && fullErrors == 8, abort());)
+
+    // Levels are switched on live stack, it stays usable
+    size_t againOff = countCheckErrors(&stk, VERIFY_OFF, 0, 8);
+    MY_ASSERT(againOff == 0, abort());
+    stackSetVerifyLevel(&stk, VERIFY_FULL, 0);
+    stackPush(&stk, 100);
+    MY_ASSERT(stackCheck(&stk) == STACK_OK && stackPop(&stk) == 100, abort());
+    logPrint(L_ZERO, 1, "Verify levels: %zu off, %zu canary, %zu sampled, %zu full errors after 8 pushes\n",
+                        offErrors, canaryErrors, sampledErrors, fullErrors);
+    stackDtor(&stk);
+}
@@ -0,0 +1,223 @@
+#define LOG_SUBSYSTEM LOG_SUB_STACK
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "utils.h"
+#include "cStack.h"
+#include "segStack.h"
+
+static segChunk_t *chunkAlloc(SegStack_t *stk);
+static void chunkFree(SegStack_t *stk, segChunk_t *chunk);
+static StackError_t chunkCheck(segChunk_t *chunk);
+static StackError_t segStackCheckBase(SegStack_t *stk, bool allChunks);
+ON_HASH(
+static hash_t getSegStackHash(SegStack_t *stk);
+)
+
+static segChunk_t *chunkAlloc(SegStack_t *stk) {
+    segChunk_t *chunk = (segChunk_t *) stk->allocator->alloc(stk->allocator->ctx, sizeof(segChunk_t));
+    MY_ASSERT(chunk, abort());
+    logPrintWithTime(L_EXTRA, 0, "SegStack_t[%p] new chunk(%s): %p\n", stk, stk->allocator->name, chunk);
+    ON_CANARY(
+    chunk->goose1 = chunk->goose2 = (canary_t) chunk ^ XOR_CONST;
+    )
+    chunk->prev = NULL;
+    return chunk;
+}
+
+static void chunkFree(SegStack_t *stk, segChunk_t *chunk) {
+    logPrintWithTime(L_EXTRA, 0, "SegStack_t[%p] free chunk: %p\n", stk, chunk);
+    stk->allocator->free(stk->allocator->ctx, chunk, sizeof(segChunk_t));
+}
+
+static StackError_t chunkCheck(segChunk_t *chunk) {
+    (void) chunk;
+    StackError_t err = STACK_OK;
+    ON_CANARY(
+    if ((chunk->goose1 ^ XOR_CONST) != (canary_t) chunk)
+        err |= ERR_DATA_CANARY_LEFT;
+    if ((chunk->goose2 ^ XOR_CONST) != (canary_t) chunk)
+        err |= ERR_DATA_CANARY_RIGHT;
+    )
+    return err;
+}
+
+StackError_t segStackCtor(SegStack_t *stk, const StackAllocator_t *allocator) {
+    MY_ASSERT(stk, abort());
+    memset(stk, 0, sizeof(*stk));
+    ON_CANARY(
+    stk->goose1 = stk->goose2 = (canary_t) stk ^ XOR_CONST;
+    )
+    stk->allocator = allocator ? allocator : stackGetDefaultAllocator();
+    ON_HASH(
+    stk->stackHash = getSegStackHash(stk);
+    )
+    SEG_STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+StackError_t segStackDtor(SegStack_t *stk) {
+    SEG_STACK_ASSERT(stk);
+    while (stk->top) {
+        segChunk_t *prev = stk->top->prev;
+        chunkFree(stk, stk->top);
+        stk->top = prev;
+    }
+    if (stk->spare)
+        chunkFree(stk, stk->spare);
+    memset(stk, 0, sizeof(*stk));
+    return STACK_OK;
+}
+
+StackError_t segStackPush(SegStack_t *stk, stkElem_t val) {
+    SEG_STACK_ASSERT(stk);
+    if (!stk->top || stk->topCount == SEG_CHUNK_ELEMS) {
+        segChunk_t *chunk = stk->spare ? stk->spare : chunkAlloc(stk);
+        stk->spare = NULL;
+        chunk->prev = stk->top;
+        stk->top = chunk;
+        stk->topCount = 0;
+        stk->chunksCount++;
+    }
+    stk->top->elems[stk->topCount++] = val;
+    stk->size++;
+    ON_HASH(
+    stk->stackHash = getSegStackHash(stk);
+    )
+    SEG_STACK_ASSERT(stk);
+    return STACK_OK;
+}
+
+stkElem_t segStackPop(SegStack_t *stk) {
+    SEG_STACK_ASSERT(stk);
+    MY_ASSERT(stk->size > 0, abort());
+
+    stkElem_t val = stk->top->elems[--stk->topCount];
+    memcpy(stk->top->elems + stk->topCount, &POISON_ELEM, sizeof(stkElem_t));
+    stk->size--;
+
+    if (stk->topCount == 0) {
+        // Keep only one spare: the older one is further from top
+        if (stk->spare)
+            chunkFree(stk, stk->spare);
+        stk->spare = stk->top;
+        stk->top = stk->top->prev;
+        stk->spare->prev = NULL;
+        stk->topCount = stk->top ? SEG_CHUNK_ELEMS : 0;
+        stk->chunksCount--;
+    }
+    ON_HASH(
+    stk->stackHash = getSegStackHash(stk);
+    )
+    SEG_STACK_ASSERT(stk);
+    return val;
+}
+
+stkElem_t *segStackTop(SegStack_t *stk) {
+    SEG_STACK_ASSERT(stk);
+    MY_ASSERT(stk->size > 0, abort());
+    return stk->top->elems + stk->topCount - 1;
+}
+
+size_t segStackGetSize(SegStack_t *stk) {
+    SEG_STACK_ASSERT(stk);
+    return stk->size;
+}
+
+StackError_t segStackVerify(SegStack_t *stk) {
+    return segStackCheckBase(stk, true);
+}
+
+StackError_t segStackCheck(SegStack_t *stk) {
+    return segStackCheckBase(stk, false);
+}
+
+/// allChunks = false checks only top and spare chunks
+static StackError_t segStackCheckBase(SegStack_t *stk, bool allChunks) {
+    StackError_t err = STACK_OK;
+    if (stk == NULL)
+        return (err = ERR_NULLPTR);
+
+    ON_CANARY(
+    if ((stk->goose1 ^ XOR_CONST) != (canary_t) stk)
+        err |= ERR_CANARY_LEFT;
+    if ((stk->goose2 ^ XOR_CONST) != (canary_t) stk)
+        err |= ERR_CANARY_RIGHT;
+    )
+    ON_HASH(
+    if (stk->stackHash != getSegStackHash(stk))
+        err |= ERR_HASH_STACK;
+    )
+    if (stk->topCount > SEG_CHUNK_ELEMS)
+        err |= ERR_LOGIC;
+    if ((stk->top == NULL) != (stk->chunksCount == 0) || (stk->top && stk->topCount == 0))
+        err |= ERR_DATA;
+    if (stk->chunksCount && stk->size != (stk->chunksCount - 1) * SEG_CHUNK_ELEMS + stk->topCount)
+        err |= ERR_SIZE;
+    if (err & (ERR_DATA + ERR_HASH_STACK))
+        return err;     // chunk pointers can't be trusted
+
+    if (stk->spare)
+        err |= chunkCheck(stk->spare);
+    size_t chunks = 0;
+    for (segChunk_t *chunk = stk->top; chunk && (allChunks || chunks == 0); chunk = chunk->prev, chunks++)
+        err |= chunkCheck(chunk);
+    if (allChunks && chunks != stk->chunksCount)
+        err |= ERR_DATA;
+    return err;
+}
+
+StackError_t segStackDumpBase(SegStack_t *stk, const char *file, int line, const char *function) {
+    logPrintWithTime(L_ZERO, 0, "SegStack_t dump:\n");
+    logPrint(L_ZERO, 0, "called from %s:%d (%s)\n", file, line, function);
+    StackError_t stkError = segStackVerify(stk);
+    if (stkError & ERR_NULLPTR) {
+        logPrint(L_ZERO, 0, "NULL pointer has been passed\n");
+        return false;
+    }
+    logPrint(L_ZERO, 0, "[%p] {\n", stk);
+    logPrint(L_ZERO, 0, "\terr      = %s\n", stackFirstErrorToStr(stkError));
+    ON_CANARY(
+    logPrint(L_ZERO, 0, "\tCanary1  = %zX\n", stk->goose1);
+    logPrint(L_ZERO, 0, "\tCanary2  = %zX\n", stk->goose2);
+    )
+    logPrint(L_ZERO, 0, "\tsize     = %zu\n", stk->size);
+    logPrint(L_ZERO, 0, "\tchunks   = %zu x %zu, %zu in top, spare %p\n",
+                        stk->chunksCount, SEG_CHUNK_ELEMS, stk->topCount, stk->spare);
+    ON_HASH(
+    logPrint(L_ZERO, 0, "\tstackHash = %#.16zX\n", stk->stackHash);
+    )
+    if (stkError & (ERR_DATA + ERR_HASH_STACK)) {
+        logPrint(L_ZERO, 0, "\t!!!Chunks may be corrupted!!!\n}\n");
+        return true;
+    }
+
+    // Chunks are linked from top, so elements are printed from top to bottom
+    size_t index = stk->size;
+    size_t count = stk->topCount;
+    for (segChunk_t *chunk = stk->top; chunk; chunk = chunk->prev) {
+        logPrint(L_ZERO, 0, "\tchunk[%p] %s{\n", chunk, chunkCheck(chunk) ? "BROKEN CANARIES " : "");
+        for (size_t idx = count; idx > 0; idx--)
+            logPrint(L_ZERO, 0, "\t* [%3zu] " STK_ELEM_FMT "\n", --index, chunk->elems[idx - 1]);
+        logPrint(L_ZERO, 0, "\t}\n");
+        count = SEG_CHUNK_ELEMS;
+    }
+    logPrint(L_ZERO, 0, "}\n");
+    return true;
+}
+
+ON_HASH(
+static hash_t getSegStackHash(SegStack_t *stk) {
+    hash_t oldHash = stk->stackHash;
+    stk->stackHash = 0;
+    hash_t newHash = memHash(stk, sizeof(*stk));
+    stk->stackHash = oldHash;
+    return newHash;
+}
+)
@@ -0,0 +1,386 @@
+#define LOG_SUBSYSTEM LOG_SUB_MEMORY
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "stackAlloc.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+# include <sanitizer/asan_interface.h>
+# define POOL_POISON(ptr, len)   ASAN_POISON_MEMORY_REGION(ptr, len)
+# define POOL_UNPOISON(ptr, len) ASAN_UNPOISON_MEMORY_REGION(ptr, len)
+#else
+# define POOL_POISON(ptr, len)   ((void) (ptr), (void) (len))
+# define POOL_UNPOISON(ptr, len) ((void) (ptr), (void) (len))
+#endif
+
+static void *mallocAlloc  (void *ctx, size_t bytes);
+static void *mallocRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes);
+static void  mallocFree   (void *ctx, void *block, size_t bytes);
+
+static void *fileAlloc  (void *ctx, size_t bytes);
+static void *fileRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes);
+static void  fileFree   (void *ctx, void *block, size_t bytes);
+
+static void *guardAlloc  (void *ctx, size_t bytes);
+static void *guardRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes);
+static void  guardFree   (void *ctx, void *block, size_t bytes);
+
+static void *poolAlloc  (void *ctx, size_t bytes);
+static void *poolRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes);
+static void  poolFree   (void *ctx, void *block, size_t bytes);
+
+const StackAllocator_t STACK_MALLOC_ALLOCATOR = {"malloc", mallocAlloc, mallocRealloc, mallocFree, NULL};
+const StackAllocator_t STACK_POOL_ALLOCATOR   = {"pool",   poolAlloc,   poolRealloc,   poolFree,   NULL};
+
+/// @brief Side of block that touches its guard page
+enum GuardSide {
+    GUARD_ABOVE,        ///< Block ends at trailing guard page
+    GUARD_BELOW         ///< Block starts at leading guard page
+};
+static GuardSide guardAboveSide = GUARD_ABOVE;
+static GuardSide guardBelowSide = GUARD_BELOW;
+
+const StackAllocator_t STACK_GUARD_ALLOCATOR       = {"guard",       guardAlloc, guardRealloc, guardFree, &guardAboveSide};
+const StackAllocator_t STACK_GUARD_BELOW_ALLOCATOR = {"guard-below", guardAlloc, guardRealloc, guardFree, &guardBelowSide};
+
+#ifdef STACK_GUARD_PAGES
+static const StackAllocator_t *defaultAllocator = &STACK_GUARD_ALLOCATOR;
+#else
+static const StackAllocator_t *defaultAllocator = &STACK_POOL_ALLOCATOR;
+#endif
+
+const StackAllocator_t *stackGetDefaultAllocator() {
+    return defaultAllocator;
+}
+
+void stackSetDefaultAllocator(const StackAllocator_t *allocator) {
+    MY_ASSERT(allocator, return);
+    defaultAllocator = allocator;
+}
+
+/*------------------MALLOC ALLOCATOR------------------------------------------*/
+
+static void *mallocAlloc(void *ctx, size_t bytes) {
+    (void) ctx;
+    return malloc(bytes);
+}
+
+static void *mallocRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes) {
+    (void) ctx; (void) oldBytes;
+    return realloc(block, newBytes);
+}
+
+static void mallocFree(void *ctx, void *block, size_t bytes) {
+    (void) ctx; (void) bytes;
+    free(block);
+}
+
+/*------------------GUARD PAGE ALLOCATOR--------------------------------------*/
+
+static const size_t GUARD_MAX_ALIGN = 16;
+
+static size_t guardPageBytes();
+static size_t guardDataPages(size_t bytes);
+static size_t guardOffset(GuardSide side, size_t bytes);
+
+static size_t guardPageBytes() {
+    static const size_t pageBytes = (size_t) sysconf(_SC_PAGESIZE);
+    return pageBytes;
+}
+
+static size_t guardDataPages(size_t bytes) {
+    return (bytes + guardPageBytes() - 1) / guardPageBytes();
+}
+
+/// Offset of block from first data page; block ends at guard page when its size is multiple of alignment
+static size_t guardOffset(GuardSide side, size_t bytes) {
+    if (side == GUARD_BELOW)
+        return 0;
+    // Largest power of two dividing bytes is enough alignment for elements of block
+    size_t align = bytes & (~bytes + 1);
+    if (align == 0 || align > GUARD_MAX_ALIGN)
+        align = GUARD_MAX_ALIGN;
+    size_t alignedBytes = (bytes + align - 1) & ~(align - 1);
+    return guardDataPages(bytes) * guardPageBytes() - alignedBytes;
+}
+
+/// Mapping is [guard page][data pages][guard page]
+static void *guardAlloc(void *ctx, size_t bytes) {
+    GuardSide side = *(const GuardSide *) ctx;
+    size_t page = guardPageBytes(), dataPages = guardDataPages(bytes);
+    char *base = (char *) mmap(NULL, (dataPages + 2) * page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (mprotect(base + page, dataPages * page, PROT_READ | PROT_WRITE) != 0) {
+        munmap(base, (dataPages + 2) * page);
+        return NULL;
+    }
+    logPrintWithTime(L_EXTRA, 0, "Guarded block: %zu pages at %p\n", dataPages, base + page);
+    return base + page + guardOffset(side, bytes);
+}
+
+/// Data pages are moved by mremap, not copied; only block of GUARD_ABOVE side
+/// is moved inside pages to keep its end at trailing guard page
+static void *guardRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes) {
+    GuardSide side = *(const GuardSide *) ctx;
+    size_t copyBytes = (oldBytes < newBytes) ? oldBytes : newBytes;
+    size_t page = guardPageBytes(), oldPages = guardDataPages(oldBytes), newPages = guardDataPages(newBytes);
+    char *base = (char *) block - guardOffset(side, oldBytes) - page;
+    if (oldPages == newPages) {
+        // Same mapping, block only moves to its new border
+        char *newBlock = base + page + guardOffset(side, newBytes);
+        memmove(newBlock, block, copyBytes);
+        return newBlock;
+    }
+
+    // Address may be mapped again, sanitizer must not remember poison of stack tail
+    POOL_UNPOISON(base + page, oldPages * page);
+    if (newPages < oldPages) {
+        char *newBlock = base + page + guardOffset(side, newBytes);
+        memmove(newBlock, block, copyBytes);
+        // Page after data becomes trailing guard, the rest is returned
+        mprotect(base + (newPages + 1) * page, page, PROT_NONE);
+        munmap(base + (newPages + 2) * page, (oldPages - newPages) * page);
+        return newBlock;
+    }
+
+    // Old data pages replace start of new reservation, so old mapping is left only with its guards
+    char *newBase = (char *) mmap(NULL, (newPages + 2) * page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (newBase == MAP_FAILED)
+        return NULL;
+    if (mprotect(newBase + page, newPages * page, PROT_READ | PROT_WRITE) != 0 ||
+        mremap(base + page, oldPages * page, oldPages * page, MREMAP_MAYMOVE | MREMAP_FIXED, newBase + page) == MAP_FAILED) {
+        munmap(newBase, (newPages + 2) * page);
+        return NULL;
+    }
+    munmap(base, page);
+    munmap(base + (oldPages + 1) * page, page);
+
+    char *newBlock = newBase + page + guardOffset(side, newBytes);
+    memmove(newBlock, newBase + page + guardOffset(side, oldBytes), copyBytes);
+    logPrintWithTime(L_EXTRA, 0, "Guarded block: %zu -> %zu pages at %p\n", oldPages, newPages, newBase + page);
+    return newBlock;
+}
+
+static void guardFree(void *ctx, void *block, size_t bytes) {
+    if (!block) return;
+    GuardSide side = *(const GuardSide *) ctx;
+    size_t page = guardPageBytes(), dataPages = guardDataPages(bytes);
+    char *base = (char *) block - guardOffset(side, bytes) - page;
+    // Address may be mapped again, sanitizer must not remember poison of stack tail
+    POOL_UNPOISON(base + page, dataPages * page);
+    munmap(base, (dataPages + 2) * page);
+}
+
+/*------------------POOL ALLOCATOR--------------------------------------------*/
+
+static const size_t MIN_CLASS   = 6;    // log2(POOL_MIN_CLASS_BYTES)
+static const size_t CLASS_COUNT = 15;   // log2(POOL_MAX_CLASS_BYTES) - MIN_CLASS + 1
+
+static size_t sizeClass(size_t bytes);
+static size_t classBytes(size_t cls);
+
+/// @brief Free block in cache, link is stored in block itself
+typedef struct poolBlock {
+    struct poolBlock *next;
+} poolBlock_t;
+
+/// @brief Thread-local cache, returns blocks to system when thread exits
+struct PoolCache {
+    poolBlock_t *heads[CLASS_COUNT];
+    size_t counts[CLASS_COUNT];
+
+    PoolCache() : heads(), counts() {}
+    PoolCache(const PoolCache &) = delete;
+    PoolCache &operator=(const PoolCache &) = delete;
+    ~PoolCache() { trim(); }
+
+    void trim() {
+        for (size_t cls = 0; cls < CLASS_COUNT; cls++) {
+            while (heads[cls]) {
+                poolBlock_t *block = heads[cls];
+                POOL_UNPOISON(block, classBytes(cls));
+                heads[cls] = block->next;
+                free(block);
+            }
+            counts[cls] = 0;
+        }
+    }
+};
+
+static thread_local PoolCache poolCache;
+
+/// Index of smallest class that fits bytes, CLASS_COUNT if bytes is too big
+static size_t sizeClass(size_t bytes) {
+    if (bytes > POOL_MAX_CLASS_BYTES)
+        return CLASS_COUNT;
+    if (bytes <= POOL_MIN_CLASS_BYTES)
+        return 0;
+    // ceil(log2(bytes)) - MIN_CLASS
+    return (size_t) (64 - __builtin_clzll((unsigned long long) (bytes - 1))) - MIN_CLASS;
+}
+
+static size_t classBytes(size_t cls) {
+    return (size_t) 1 << (cls + MIN_CLASS);
+}
+
+static void *poolAlloc(void *ctx, size_t bytes) {
+    (void) ctx;
+    size_t cls = sizeClass(bytes);
+    if (cls == CLASS_COUNT)
+        return malloc(bytes);
+
+    poolBlock_t *block = poolCache.heads[cls];
+    if (block) {
+        POOL_UNPOISON(block, sizeof(poolBlock_t));
+        poolCache.heads[cls] = block->next;
+        poolCache.counts[cls]--;
+    } else {
+        block = (poolBlock_t *) malloc(classBytes(cls));
+        if (!block) return NULL;
+    }
+    // Class slack is not part of block: let sanitizer catch accesses to it
+    POOL_UNPOISON(block, bytes);
+    POOL_POISON((char *) block + bytes, classBytes(cls) - bytes);
+    return block;
+}
+
+static void *poolRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes) {
+    size_t oldCls = sizeClass(oldBytes), newCls = sizeClass(newBytes);
+    if (oldCls == CLASS_COUNT && newCls == CLASS_COUNT)
+        return realloc(block, newBytes);
+
+    if (oldCls == newCls) {
+        // Same class: nothing moves
+        POOL_UNPOISON(block, newBytes);
+        POOL_POISON((char *) block + newBytes, classBytes(newCls) - newBytes);
+        return block;
+    }
+
+    void *newBlock = poolAlloc(ctx, newBytes);
+    if (!newBlock) return NULL;
+    memcpy(newBlock, block, (oldBytes < newBytes) ? oldBytes : newBytes);
+    poolFree(ctx, block, oldBytes);
+    return newBlock;
+}
+
+static void poolFree(void *ctx, void *block, size_t bytes) {
+    (void) ctx;
+    if (!block) return;
+    size_t cls = sizeClass(bytes);
+    if (cls == CLASS_COUNT || poolCache.counts[cls] >= POOL_MAX_CACHED ||
+        (poolCache.counts[cls] + 1) * classBytes(cls) > POOL_MAX_CACHED_BYTES) {
+        POOL_UNPOISON(block, (cls == CLASS_COUNT) ? bytes : classBytes(cls));
+        free(block);
+        return;
+    }
+
+    POOL_UNPOISON(block, sizeof(poolBlock_t));
+    poolBlock_t *cached = (poolBlock_t *) block;
+    cached->next = poolCache.heads[cls];
+    poolCache.heads[cls] = cached;
+    poolCache.counts[cls]++;
+    POOL_POISON(block, classBytes(cls));
+}
+
+void stackPoolTrim() {
+    logPrintWithTime(L_DEBUG, 0, "Trimming stack pool of current thread\n");
+    poolCache.trim();
+}
+
+/*------------------FILE ALLOCATOR--------------------------------------------*/
+
+static bool fileMapResize(StackFileMap_t *map, size_t blockBytes);
+
+StackFileMap_t *stackFileMapOpen(const char *path) {
+    MY_ASSERT(path, abort());
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        logPrintWithTime(L_ZERO, 1, "Can't open stack file %s\n", path);
+        return NULL;
+    }
+    struct stat fileStat = {};
+    if (fstat(fd, &fileStat) != 0 ||
+        ((size_t) fileStat.st_size < STACK_FILE_HEADER_BYTES && ftruncate(fd, (off_t) STACK_FILE_HEADER_BYTES) != 0)) {
+        logPrintWithTime(L_ZERO, 1, "Can't stat or extend stack file %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    size_t fileBytes = ((size_t) fileStat.st_size < STACK_FILE_HEADER_BYTES) ?
+                        STACK_FILE_HEADER_BYTES : (size_t) fileStat.st_size;
+
+    void *base = mmap(NULL, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        logPrintWithTime(L_ZERO, 1, "Can't map stack file %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    StackFileMap_t *map = (StackFileMap_t *) calloc(1, sizeof(StackFileMap_t));
+    MY_ASSERT(map, abort());
+    map->fd = fd;
+    map->base = (char *) base;
+    map->blockBytes = fileBytes - STACK_FILE_HEADER_BYTES;
+    map->allocator = {"file", fileAlloc, fileRealloc, fileFree, map};
+    logPrintWithTime(L_DEBUG, 0, "Mapped stack file %s: %zu bytes at %p\n", path, fileBytes, base);
+    return map;
+}
+
+int stackFileMapSync(StackFileMap_t *map) {
+    MY_ASSERT(map, abort());
+    return msync(map->base, STACK_FILE_HEADER_BYTES + map->blockBytes, MS_SYNC);
+}
+
+void stackFileMapClose(StackFileMap_t *map) {
+    if (!map) return;
+    munmap(map->base, STACK_FILE_HEADER_BYTES + map->blockBytes);
+    close(map->fd);
+    free(map);
+}
+
+/// Change file and mapping size; file is extended before mapping and truncated after it
+static bool fileMapResize(StackFileMap_t *map, size_t blockBytes) {
+    size_t oldBytes = STACK_FILE_HEADER_BYTES + map->blockBytes;
+    size_t newBytes = STACK_FILE_HEADER_BYTES + blockBytes;
+    if (newBytes > oldBytes && ftruncate(map->fd, (off_t) newBytes) != 0)
+        return false;
+    void *base = mremap(map->base, oldBytes, newBytes, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+        return false;
+    if (newBytes < oldBytes && ftruncate(map->fd, (off_t) newBytes) != 0)
+        return false;
+    logPrintWithTime(L_DEBUG, 0, "Stack file remapped: %zu bytes, %p --> %p\n", newBytes, map->base, base);
+    map->base = (char *) base;
+    map->blockBytes = blockBytes;
+    return true;
+}
+
+static void *fileAlloc(void *ctx, size_t bytes) {
+    StackFileMap_t *map = (StackFileMap_t *) ctx;
+    // There is only one block in file
+    MY_ASSERT(map->blockBytes == 0, abort());
+    return fileMapResize(map, bytes) ? map->base + STACK_FILE_HEADER_BYTES : NULL;
+}
+
+static void *fileRealloc(void *ctx, void *block, size_t oldBytes, size_t newBytes) {
+    StackFileMap_t *map = (StackFileMap_t *) ctx;
+    MY_ASSERT(block == map->base + STACK_FILE_HEADER_BYTES && oldBytes == map->blockBytes, abort());
+    return fileMapResize(map, newBytes) ? map->base + STACK_FILE_HEADER_BYTES : NULL;
+}
+
+static void fileFree(void *ctx, void *block, size_t bytes) {
+    StackFileMap_t *map = (StackFileMap_t *) ctx;
+    if (!block) return;
+    MY_ASSERT(block == map->base + STACK_FILE_HEADER_BYTES && bytes == map->blockBytes, abort());
+    fileMapResize(map, 0);
+}
@@ -0,0 +1,207 @@
+#define LOG_SUBSYSTEM LOG_SUB_STACK
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "utils.h"
+#include "cStack.h"
+#include "stackSnapshot.h"
+
+static bool writevAll(int fd, struct iovec *iov, int iovcnt);
+static bool readAll(int fd, void *buffer, size_t len);
+static uint64_t getHeaderChecksum(const StackSnapshotHeader_t *header);
+static uint64_t getDataChecksum(const StackSnapshotHeader_t *header, const void *data, size_t bytes, size_t firstPos);
+static StackError_t writeRecord(Stack_t *stk, int fd, enum StackSnapshotKind kind);
+static StackError_t loadFull(Stack_t *stk, int fd, const StackSnapshotHeader_t *header);
+static StackError_t loadDelta(Stack_t *stk, int fd, const StackSnapshotHeader_t *header);
+
+/// Repeat writev until everything is written, iov is changed
+static bool writevAll(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        size_t left = (size_t) written;
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+/// Repeat read until len bytes are read, false on error or end of file
+static bool readAll(int fd, void *buffer, size_t len) {
+    char *pos = (char *) buffer;
+    while (len > 0) {
+        ssize_t got = read(fd, pos, len);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        pos += got;
+        len -= (size_t) got;
+    }
+    return true;
+}
+
+static uint64_t getHeaderChecksum(const StackSnapshotHeader_t *header) {
+    StackSnapshotHeader_t copy = *header;
+    copy.headerChecksum = 0;
+    return memHashWithBackend((enum MemHashBackend) header->hashBackend, &copy, sizeof(copy), 0);
+}
+
+/// Checksum of bytes of record elements starting at firstPos, which is multiple of blockBytes
+static uint64_t getDataChecksum(const StackSnapshotHeader_t *header, const void *data, size_t bytes, size_t firstPos) {
+    uint64_t checksum = 0;
+    for (size_t pos = 0; pos < bytes; pos += header->blockBytes) {
+        size_t len = (bytes - pos < header->blockBytes) ? bytes - pos : header->blockBytes;
+        checksum += memHashWithBackend((enum MemHashBackend) header->hashBackend,
+                                       (const char *) data + pos, len, (firstPos + pos) / header->blockBytes);
+    }
+    return checksum;
+}
+
+StackError_t stackSave(Stack_t *stk, int fd) {
+    return writeRecord(stk, fd, SNAPSHOT_FULL);
+}
+
+StackError_t stackSaveDelta(Stack_t *stk, int fd) {
+    STACK_ASSERT(stk);
+    return writeRecord(stk, fd, (stk->checkpointTag) ? SNAPSHOT_DELTA : SNAPSHOT_FULL);
+}
+
+static StackError_t writeRecord(Stack_t *stk, int fd, enum StackSnapshotKind kind) {
+    STACK_ASSERT(stk);
+    MY_ASSERT(fd >= 0, abort());
+
+    StackSnapshotHeader_t header = {};
+    header.magic       = STACK_SNAPSHOT_MAGIC;
+    header.version     = STACK_SNAPSHOT_VERSION;
+    header.elemSize    = sizeof(stkElem_t);
+    header.kind        = kind;
+    header.hashBackend = getMemHashBackend();
+    header.blockBytes  = SNAPSHOT_BLOCK_BYTES;
+    if (kind == SNAPSHOT_DELTA) {
+        header.baseTag = stk->checkpointTag;
+        header.keep    = stk->lowWater;
+    }
+    header.count = stk->size - header.keep;
+
+    stkElem_t *elems = (stk->data) ? stk->data + header.keep : NULL;
+    size_t bytes = header.count * sizeof(stkElem_t);
+    header.dataChecksum   = getDataChecksum(&header, elems, bytes, 0);
+    header.headerChecksum = getHeaderChecksum(&header);
+
+    struct iovec iov[2] = {{&header, sizeof(header)}, {elems, bytes}};
+    if (!writevAll(fd, iov, (bytes) ? 2 : 1)) {
+        logPrintWithTime(L_ZERO, 1, "Stack_t[%p] snapshot write failed\n", stk);
+        return ERR_FILE;
+    }
+    logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] saved %s snapshot: %zu elements, %zu kept\n", stk,
+                     (kind == SNAPSHOT_DELTA) ? "delta" : "full", header.count, header.keep);
+    return stackMarkCheckpoint(stk, header.headerChecksum);
+}
+
+StackError_t stackLoad(Stack_t *stk, int fd) {
+    STACK_ASSERT(stk);
+    MY_ASSERT(fd >= 0, abort());
+
+    StackSnapshotHeader_t header = {};
+    if (!readAll(fd, &header, sizeof(header)))
+        return ERR_FILE;
+    if (header.magic != STACK_SNAPSHOT_MAGIC || header.version != STACK_SNAPSHOT_VERSION ||
+        header.elemSize != sizeof(stkElem_t) || header.kind > SNAPSHOT_DELTA ||
+        header.hashBackend > MEM_HASH_CRC32C ||
+        header.blockBytes == 0 || header.blockBytes % sizeof(stkElem_t) != 0) {
+        logPrintWithTime(L_ZERO, 1, "Stack snapshot has unknown format\n");
+        return ERR_FILE;
+    }
+    if (header.headerChecksum != getHeaderChecksum(&header))
+        return ERR_HASH_STACK;
+
+    StackError_t err = (header.kind == SNAPSHOT_DELTA) ? loadDelta(stk, fd, &header) : loadFull(stk, fd, &header);
+    if (err)
+        logPrintWithTime(L_ZERO, 1, "Stack_t[%p] snapshot is broken: %s\n", stk, stackFirstErrorToStr(err));
+    return err;
+}
+
+/// Full snapshot can be huge: it is read by blocks and pushed, then popped back if it's broken
+static StackError_t loadFull(Stack_t *stk, int fd, const StackSnapshotHeader_t *header) {
+    if (header->count >= MAX_STACK_SIZE - stk->size)
+        return ERR_SIZE;
+
+    bool wasEmpty = (stk->size == 0);
+    size_t bytes = header->count * sizeof(stkElem_t);
+    size_t bufferBytes = (bytes < header->blockBytes) ? bytes : header->blockBytes;
+    stkElem_t *buffer = (stkElem_t *) malloc(bufferBytes);
+    MY_ASSERT(buffer || bufferBytes == 0, abort());
+    stackReserve(stk, stk->size + header->count);
+
+    // Checksum blocks are read one by one, so file is read once and buffer stays in cache
+    StackError_t err = STACK_OK;
+    uint64_t checksum = 0;
+    size_t loaded = 0;
+    for (size_t pos = 0; pos < bytes; pos += header->blockBytes) {
+        size_t len = (bytes - pos < header->blockBytes) ? bytes - pos : header->blockBytes;
+        if (!readAll(fd, buffer, len)) {
+            err = ERR_FILE;
+            break;
+        }
+        checksum += getDataChecksum(header, buffer, len, pos);
+        stackPushN(stk, buffer, len / sizeof(stkElem_t));
+        loaded += len / sizeof(stkElem_t);
+    }
+    free(buffer);
+    if (!err && checksum != header->dataChecksum)
+        err = ERR_HASH_DATA;
+    if (err) {
+        stackPopN(stk, NULL, loaded);
+        return err;
+    }
+    logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] loaded full snapshot: %zu elements\n", stk, loaded);
+    // Deltas describe writer's stack, they can't be applied if something lies below
+    return stackMarkCheckpoint(stk, (wasEmpty) ? header->headerChecksum : 0);
+}
+
+/// Delta is small: it is checked before popped elements are lost
+static StackError_t loadDelta(Stack_t *stk, int fd, const StackSnapshotHeader_t *header) {
+    if (stk->checkpointTag == 0 || header->baseTag != stk->checkpointTag)
+        return ERR_HASH_STACK;
+    if (header->keep > stk->size || header->count >= MAX_STACK_SIZE - header->keep)
+        return ERR_SIZE;
+
+    size_t bytes = header->count * sizeof(stkElem_t);
+    stkElem_t *buffer = (stkElem_t *) malloc(bytes);
+    MY_ASSERT(buffer || bytes == 0, abort());
+    StackError_t err = STACK_OK;
+    if (!readAll(fd, buffer, bytes))
+        err = ERR_FILE;
+    else if (getDataChecksum(header, buffer, bytes, 0) != header->dataChecksum)
+        err = ERR_HASH_DATA;
+
+    if (!err) {
+        stackPopN(stk, NULL, stk->size - header->keep);
+        stackPushN(stk, buffer, header->count);
+        logPrintWithTime(L_DEBUG, 0, "Stack_t[%p] loaded delta snapshot: %zu elements, %zu kept\n",
+                         stk, header->count, header->keep);
+        err = stackMarkCheckpoint(stk, header->headerChecksum);
+    }
+    free(buffer);
+    return err;
+}
@@ -5,6 +5,51 @@
 #include <string.h>
 #include "utils.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define UTILS_X86_SIMD
+#endif
+
+static const size_t SIMD_PATTERN_BYTES = 32;    ///< Widest register, fill pattern is doubled up to it
+static const size_t FILL_BLOCK_BYTES   = 4096;  ///< Doubling fill copies from block that stays in L1
+
+static enum SimdLevel *activeSimdLevel();
+static void swapScalar(void* a, void* b, size_t len);
+static void fillScalar(char *dst, const char *pattern, size_t bytes);
+static void fillDoubling(char *dst, size_t period, size_t bytes);
+
+#ifdef UTILS_X86_SIMD
+__attribute__((target("sse2"))) static void swapSSE2(char *a, char *b, size_t len);
+__attribute__((target("avx2"))) static void swapAVX2(char *a, char *b, size_t len);
+__attribute__((target("sse2"))) static void fillSSE2(char *dst, const char *pattern, size_t bytes);
+__attribute__((target("avx2"))) static void fillAVX2(char *dst, const char *pattern, size_t bytes);
+#endif
+
+/*------------------SIMD DISPATCH---------------------------------------------*/
+
+enum SimdLevel getSimdLevel() {
+#ifdef UTILS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+enum SimdLevel setSimdLevel(enum SimdLevel level) {
+    enum SimdLevel supported = getSimdLevel();
+    *activeSimdLevel() = (level < supported) ? level : supported;
+    return *activeSimdLevel();
+}
+
+/// Level used by memValSet and swap, detected on first call
+static enum SimdLevel *activeSimdLevel() {
+    static enum SimdLevel level = getSimdLevel();
+    return &level;
+}
+
 long long maxINT(long long a, long long b) {
     return (a > b) ? a : b;
 }
@@ -14,6 +59,27 @@ long long minINT(long long a, long long b) {
 }
 
 void swap(void* a, void* b, size_t len) {
+    char *ac = (char*) a, *bc = (char*) b;
+#ifdef UTILS_X86_SIMD
+    // Unaligned loads and stores: no need to align a and b
+    switch (*activeSimdLevel()) {
+        case SIMD_AVX2:
+            swapAVX2(ac, bc, len);
+            ac += len / 32 * 32; bc += len / 32 * 32; len %= 32;
+            break;
+        case SIMD_SSE2:
+            swapSSE2(ac, bc, len);
+            ac += len / 16 * 16; bc += len / 16 * 16; len %= 16;
+            break;
+        case SIMD_SCALAR:
+        default:
+            break;
+    }
+#endif
+    swapScalar(ac, bc, len);
+}
+
+static void swapScalar(void* a, void* b, size_t len) {
     //checking if a and b are correctly aligned
     const unsigned blockSize = sizeof(uint64_t);
     if ((((size_t) a) % blockSize != (((size_t) b) % blockSize))) { //TODO: sizeof(long long/uint64_t)
@@ -22,6 +88,10 @@ void swap(void* a, void* b, size_t len) {
     }
     //aligning a and b if possible
     const unsigned startOffset = (blockSize - ((size_t) a % blockSize)) % blockSize;
+    if (startOffset >= len) {
+        swapByByte(a, b, len);
+        return;
+    }
     swapByByte(a, b, startOffset);
 
     size_t llSteps = (len-startOffset) / blockSize;
@@ -77,21 +147,370 @@ doublePair_t runningSTD(double value, int getResult) {
 }
 
 void memValSet(void *start, const void *elem, size_t elemSize, size_t length) {
+    if (length == 0 || elemSize == 0)
+        return;
     char *ptr = (char*) start;
-    const char *elemPtr = (const char*) elem;
-    while (length--) {
-        memcpy(ptr, elemPtr, elemSize);
-        ptr += elemSize;
+    size_t bytes = elemSize * length;
+
+    if (SIMD_PATTERN_BYTES % elemSize != 0) {
+        // Pattern doesn't fit in register: fill by copying already filled part
+        memcpy(ptr, elem, elemSize);
+        fillDoubling(ptr, elemSize, bytes);
+        return;
+    }
+
+    // Double element up to register width
+    alignas(32) char pattern[SIMD_PATTERN_BYTES] = {};
+    memcpy(pattern, elem, elemSize);
+    for (size_t filled = elemSize; filled < SIMD_PATTERN_BYTES; filled *= 2)
+        memcpy(pattern + filled, pattern, filled);
+
+    switch (*activeSimdLevel()) {
+#ifdef UTILS_X86_SIMD
+        case SIMD_AVX2:
+            fillAVX2(ptr, pattern, bytes);
+            break;
+        case SIMD_SSE2:
+            fillSSE2(ptr, pattern, bytes);
+            break;
+#endif
+        case SIMD_SCALAR:
+        default:
+            fillScalar(ptr, pattern, bytes);
+            break;
     }
 }
 
-// DJB2 hash https://github.com/dim13/djb2/blob/master/docs/hash.md
+/// Fill bytes with 32-byte pattern, tail gets its prefix
+static void fillScalar(char *dst, const char *pattern, size_t bytes) {
+    uint64_t words[SIMD_PATTERN_BYTES / sizeof(uint64_t)] = {};
+    memcpy(words, pattern, SIMD_PATTERN_BYTES);
+    size_t steps = bytes / SIMD_PATTERN_BYTES;
+    while (steps--) {
+        memcpy(dst,      &words[0], sizeof(uint64_t));
+        memcpy(dst + 8,  &words[1], sizeof(uint64_t));
+        memcpy(dst + 16, &words[2], sizeof(uint64_t));
+        memcpy(dst + 24, &words[3], sizeof(uint64_t));
+        dst += SIMD_PATTERN_BYTES;
+    }
+    memcpy(dst, pattern, bytes % SIMD_PATTERN_BYTES);
+}
+
+/// dst already has one period of pattern; copy filled prefix forward until bytes are filled
+static void fillDoubling(char *dst, size_t period, size_t bytes) {
+    // Largest chunk is multiple of period, so pattern phase is kept
+    size_t maxChunk = (FILL_BLOCK_BYTES / period + 1) * period;
+    size_t filled = period;
+    while (filled < bytes) {
+        size_t chunk = (filled < maxChunk) ? filled : maxChunk;
+        if (chunk > bytes - filled)
+            chunk = bytes - filled;
+        memcpy(dst + filled, dst, chunk);
+        filled += chunk;
+    }
+}
+
+#ifdef UTILS_X86_SIMD
+__attribute__((target("sse2")))
+static void fillSSE2(char *dst, const char *pattern, size_t bytes) {
+    // 32-byte pattern takes two registers
+    __m128i lo = _mm_load_si128((const __m128i *) pattern);
+    __m128i hi = _mm_load_si128((const __m128i *) (pattern + 16));
+    size_t steps = bytes / SIMD_PATTERN_BYTES;
+    while (steps--) {
+        _mm_storeu_si128((__m128i *) dst,        lo);
+        _mm_storeu_si128((__m128i *) (dst + 16), hi);
+        dst += SIMD_PATTERN_BYTES;
+    }
+    memcpy(dst, pattern, bytes % SIMD_PATTERN_BYTES);
+}
+
+__attribute__((target("avx2")))
+static void fillAVX2(char *dst, const char *pattern, size_t bytes) {
+    __m256i val = _mm256_load_si256((const __m256i *) pattern);
+    size_t steps = bytes / SIMD_PATTERN_BYTES;
+    // Two stores per iteration
+    for (; steps >= 2; steps -= 2) {
+        _mm256_storeu_si256((__m256i *) dst,        val);
+        _mm256_storeu_si256((__m256i *) (dst + 32), val);
+        dst += 2 * SIMD_PATTERN_BYTES;
+    }
+    if (steps) {
+        _mm256_storeu_si256((__m256i *) dst, val);
+        dst += SIMD_PATTERN_BYTES;
+    }
+    memcpy(dst, pattern, bytes % SIMD_PATTERN_BYTES);
+}
+
+/// Swap first len / 16 * 16 bytes
+__attribute__((target("sse2")))
+static void swapSSE2(char *a, char *b, size_t len) {
+    for (size_t steps = len / 16; steps; steps--) {
+        __m128i va = _mm_loadu_si128((const __m128i *) a);
+        __m128i vb = _mm_loadu_si128((const __m128i *) b);
+        _mm_storeu_si128((__m128i *) a, vb);
+        _mm_storeu_si128((__m128i *) b, va);
+        a += 16; b += 16;
+    }
+}
+
+/// Swap first len / 32 * 32 bytes
+__attribute__((target("avx2")))
+static void swapAVX2(char *a, char *b, size_t len) {
+    for (size_t steps = len / 32; steps; steps--) {
+        __m256i va = _mm256_loadu_si256((const __m256i *) a);
+        __m256i vb = _mm256_loadu_si256((const __m256i *) b);
+        _mm256_storeu_si256((__m256i *) a, vb);
+        _mm256_storeu_si256((__m256i *) b, va);
+        a += 32; b += 32;
+    }
+}
+#endif
+
+/*------------------HASHES----------------------------------------------------*/
+
+static uint64_t djb2Hash  (const void *arr, size_t len, uint64_t seed);
+static uint64_t xxh64Hash (const void *arr, size_t len, uint64_t seed);
+static uint64_t crc32cHash(const void *arr, size_t len, uint64_t seed);
+static uint32_t crc32cSoft(uint32_t crc, const unsigned char *bytes, size_t len);
+static size_t crc32cLanesSoft(const unsigned char *bytes, size_t len, uint32_t *lanes);
+#ifdef UTILS_X86_SIMD
+__attribute__((target("sse4.2"))) static size_t crc32cLanesHard(const unsigned char *bytes, size_t len, uint32_t *lanes);
+#endif
+
+typedef uint64_t (*memHashFunc_t)(const void *arr, size_t len, uint64_t seed);
+
+static enum MemHashBackend hashBackend = MEM_HASH_DEFAULT;
+static memHashFunc_t       hashFunc    = (MEM_HASH_DEFAULT == MEM_HASH_DJB2)  ? djb2Hash :
+                                         (MEM_HASH_DEFAULT == MEM_HASH_XXH64) ? xxh64Hash : crc32cHash;
+
+void setMemHashBackend(enum MemHashBackend backend) {
+    switch (backend) {
+        case MEM_HASH_DJB2:   hashFunc = djb2Hash;   break;
+        case MEM_HASH_XXH64:  hashFunc = xxh64Hash;  break;
+        case MEM_HASH_CRC32C: hashFunc = crc32cHash; break;
+        default:              return;
+    }
+    hashBackend = backend;
+}
+
+enum MemHashBackend getMemHashBackend() {
+    return hashBackend;
+}
+
 uint64_t memHash(const void *arr, size_t len) {
     if (!arr) return 0x1DED0BEDBAD0C0DE;
-    uint64_t hash = 5381;
+    return hashFunc(arr, len, 0);
+}
+
+uint64_t memHashSeeded(const void *arr, size_t len, uint64_t seed) {
+    if (!arr) return 0x1DED0BEDBAD0C0DE ^ seed;
+    return hashFunc(arr, len, seed);
+}
+
+uint64_t memHashWithBackend(enum MemHashBackend backend, const void *arr, size_t len, uint64_t seed) {
+    if (!arr) return 0x1DED0BEDBAD0C0DE ^ seed;
+    switch (backend) {
+        case MEM_HASH_DJB2:   return djb2Hash  (arr, len, seed);
+        case MEM_HASH_XXH64:  return xxh64Hash (arr, len, seed);
+        case MEM_HASH_CRC32C: return crc32cHash(arr, len, seed);
+        default:              return 0;
+    }
+}
+
+// DJB2 hash https://github.com/dim13/djb2/blob/master/docs/hash.md
+static uint64_t djb2Hash(const void *arr, size_t len, uint64_t seed) {
+    return memHashAppend(MEM_HASH_SEED ^ seed, arr, len);
+}
+
+uint64_t memHashAppend(uint64_t hash, const void *arr, size_t len) {
     const unsigned char *carr = (const unsigned char*)arr;
     while (len--)
         hash = ((hash << 5) + hash) + *carr++;
         //hash = 33*hash + c
     return hash;
 }
+
+uint64_t memHashRemove(uint64_t hash, const void *arr, size_t len) {
+    // 33 is odd, so it is invertible modulo 2^64: 33 * INV_33 = 1
+    const uint64_t INV_33 = 0x0F83E0F83E0F83E1;
+    const unsigned char *carr = (const unsigned char*)arr + len;
+    while (len--)
+        hash = (hash - *--carr) * INV_33;
+        //hash = (hash - c) / 33
+    return hash;
+}
+
+// xxHash64 https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+static const uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87;
+static const uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4F;
+static const uint64_t XXH_PRIME3 = 0x165667B19E3779F9;
+static const uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63;
+static const uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *ptr) {
+    uint64_t val = 0;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    return rotl64(acc, 31) * XXH_PRIME1;
+}
+
+static inline uint64_t xxhMerge(uint64_t acc, uint64_t lane) {
+    acc ^= xxhRound(0, lane);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+static uint64_t xxh64Hash(const void *arr, size_t len, uint64_t seed) {
+    const unsigned char *ptr = (const unsigned char *) arr, *end = ptr + len;
+    uint64_t hash = 0;
+
+    if (len >= 32) {
+        // Four independent lanes: no dependency between consecutive 8-byte words
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2, v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed,                           v4 = seed - XXH_PRIME1;
+        for (; ptr + 32 <= end; ptr += 32) {
+            v1 = xxhRound(v1, read64(ptr));
+            v2 = xxhRound(v2, read64(ptr + 8));
+            v3 = xxhRound(v3, read64(ptr + 16));
+            v4 = xxhRound(v4, read64(ptr + 24));
+        }
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxhMerge(hash, v1);
+        hash = xxhMerge(hash, v2);
+        hash = xxhMerge(hash, v3);
+        hash = xxhMerge(hash, v4);
+    } else
+        hash = seed + XXH_PRIME5;
+
+    hash += len;
+    for (; ptr + 8 <= end; ptr += 8)
+        hash = rotl64(hash ^ xxhRound(0, read64(ptr)), 27) * XXH_PRIME1 + XXH_PRIME4;
+    if (ptr + 4 <= end) {
+        uint32_t word = 0;
+        memcpy(&word, ptr, sizeof(word));
+        hash = rotl64(hash ^ (word * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+        ptr += 4;
+    }
+    for (; ptr < end; ptr++)
+        hash = rotl64(hash ^ (*ptr * XXH_PRIME5), 11) * XXH_PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/// CRC32C (Castagnoli) byte table for CPUs without SSE4.2
+typedef struct {
+    uint32_t table[256];
+} crc32cTable_t;
+
+static crc32cTable_t makeCrc32cTable() {
+    const uint32_t POLY = 0x82F63B78;   // reversed Castagnoli polynomial
+    crc32cTable_t result = {};
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (POLY & (0 - (crc & 1)));
+        result.table[byte] = crc;
+    }
+    return result;
+}
+
+static uint32_t crc32cSoft(uint32_t crc, const unsigned char *bytes, size_t len) {
+    static const crc32cTable_t crcTable = makeCrc32cTable();
+    while (len--)
+        crc = crcTable.table[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+/// Even 8-byte words go to lanes[0], odd ones to lanes[1]
+/// @return Number of bytes processed
+static size_t crc32cLanesSoft(const unsigned char *bytes, size_t len, uint32_t *lanes) {
+    size_t pos = 0;
+    for (; pos + 16 <= len; pos += 16) {
+        lanes[0] = crc32cSoft(lanes[0], bytes + pos,     8);
+        lanes[1] = crc32cSoft(lanes[1], bytes + pos + 8, 8);
+    }
+    return pos;
+}
+
+#ifdef UTILS_X86_SIMD
+__attribute__((target("sse4.2")))
+static size_t crc32cLanesHard(const unsigned char *bytes, size_t len, uint32_t *lanes) {
+    // crc32 instruction has latency 3 and throughput 1: two lanes run in parallel
+    uint64_t crc0 = lanes[0], crc1 = lanes[1];
+    size_t pos = 0;
+    for (; pos + 16 <= len; pos += 16) {
+        crc0 = _mm_crc32_u64(crc0, read64(bytes + pos));
+        crc1 = _mm_crc32_u64(crc1, read64(bytes + pos + 8));
+    }
+    lanes[0] = (uint32_t) crc0;
+    lanes[1] = (uint32_t) crc1;
+    return pos;
+}
+#endif
+
+static uint64_t crc32cHash(const void *arr, size_t len, uint64_t seed) {
+    const unsigned char *bytes = (const unsigned char *) arr;
+    uint32_t lanes[2] = {~(uint32_t) seed, ~(uint32_t) (seed >> 32) ^ 0x5BD1E995};
+
+#ifdef UTILS_X86_SIMD
+    static const bool hasCrc32 = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+    size_t pos = hasCrc32 ? crc32cLanesHard(bytes, len, lanes) : crc32cLanesSoft(bytes, len, lanes);
+#else
+    size_t pos = crc32cLanesSoft(bytes, len, lanes);
+#endif
+    // Both instruction and table compute the same CRC32C, so tail can use table
+    lanes[0] = crc32cSoft(lanes[0], bytes + pos, len - pos);
+    lanes[1] = crc32cSoft(lanes[1], (const unsigned char *) &len, sizeof(len));
+    return ((uint64_t) ~lanes[0] << 32) | ~lanes[1];
+}
+
+memChunkHash_t memChunkHashCompute(const void *arr, size_t len) {
+    memChunkHash_t hash = {0, MEM_HASH_SEED};
+    memChunkHashGrow(&hash, arr, 0, len);
+    return hash;
+}
+
+void memChunkHashGrow(memChunkHash_t *hash, const void *arr, size_t oldLen, size_t newLen) {
+    const char *bytes = (const char *) arr;
+    size_t pos = oldLen;
+    size_t chunkStart = oldLen - oldLen % MEM_HASH_CHUNK;
+    // Chunks completed by new bytes leave tail
+    while (chunkStart + MEM_HASH_CHUNK <= newLen) {
+        hash->chunks += memHashSeeded(bytes + chunkStart, MEM_HASH_CHUNK, chunkStart / MEM_HASH_CHUNK);
+        hash->tail = MEM_HASH_SEED;
+        chunkStart += MEM_HASH_CHUNK;
+        pos = chunkStart;
+    }
+    hash->tail = memHashAppend(hash->tail, bytes + pos, newLen - pos);
+}
+
+void memChunkHashShrink(memChunkHash_t *hash, const void *arr, size_t oldLen, size_t newLen) {
+    const char *bytes = (const char *) arr;
+    size_t tailStart = oldLen - oldLen % MEM_HASH_CHUNK;
+    if (newLen >= tailStart) {
+        hash->tail = memHashRemove(hash->tail, bytes + newLen, oldLen - newLen);
+        return;
+    }
+    // Broken chunks leave sum, part of the lowest one becomes tail
+    size_t newTailStart = newLen - newLen % MEM_HASH_CHUNK;
+    for (size_t chunkStart = newTailStart; chunkStart < tailStart; chunkStart += MEM_HASH_CHUNK)
+        hash->chunks -= memHashSeeded(bytes + chunkStart, MEM_HASH_CHUNK, chunkStart / MEM_HASH_CHUNK);
+    hash->tail = memHashAppend(MEM_HASH_SEED, bytes + newTailStart, newLen - newTailStart);
+}
+
+bool memChunkHashEqual(memChunkHash_t a, memChunkHash_t b) {
+    return a.chunks == b.chunks && a.tail == b.tail;
+}
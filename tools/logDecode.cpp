@@ -0,0 +1,105 @@
+/// @file Turn binary log written after logOpenBinary into text of log.txt
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "error_debug.h"
+#include "logger.h"
+#include "logBinary.h"
+#include "argvProcessor.h"
+
+static bool readRecord(FILE *in, LogRecordHeader_t *header, std::string *body);
+static int decode(FILE *in, FILE *out);
+
+/// @return false at end of file or if record is cut
+static bool readRecord(FILE *in, LogRecordHeader_t *header, std::string *body) {
+    if (fread(header, sizeof(*header), 1, in) != 1)
+        return false;
+    body->resize(header->len);
+    return header->len == 0 || fread(&(*body)[0], header->len, 1, in) == 1;
+}
+
+/// @return Number of records that couldn't be decoded
+static int decode(FILE *in, FILE *out) {
+    std::unordered_map<uint64_t, std::string> formats;
+    LogRecordHeader_t header = {};
+    std::string body;
+    int errors = 0;
+    size_t record = 0;
+
+    for (; readRecord(in, &header, &body); record++) {
+        switch (header.type) {
+            case LOG_RECORD_SESSION:
+                if (header.id != LOG_BINARY_MAGIC) {
+                    fprintf(stderr, "Record %zu: session has wrong magic, not a binary log\n", record);
+                    return errors + 1;
+                }
+                // IDs are addresses, they are valid only in session of their process
+                formats.clear();
+                break;
+            case LOG_RECORD_FORMAT:
+                formats[header.id] = body;
+                break;
+            case LOG_RECORD_MESSAGE: {
+                auto format = formats.find(header.id);
+                if (format == formats.end()) {
+                    fprintf(out, "[message with unknown format %llX]\n", (unsigned long long) header.id);
+                    errors++;
+                    break;
+                }
+                if (header.withTime) {
+                    struct timespec time = {header.timeNs / 1000000000, header.timeNs % 1000000000};
+                    char prefix[64] = "";
+                    logFormatTime(prefix, sizeof(prefix), &time);
+                    fputs(prefix, out);
+                }
+                if (!logDecodeMessage(out, format->second.c_str(), body.data(), body.size())) {
+                    fprintf(stderr, "Record %zu: arguments don't match format \"%s\"\n", record, format->second.c_str());
+                    errors++;
+                }
+                break;
+            }
+            default:
+                fprintf(stderr, "Record %zu: unknown type %u, log is broken\n", record, header.type);
+                return errors + 1;
+        }
+    }
+    if (!feof(in)) {
+        fprintf(stderr, "Record %zu is cut\n", record);
+        errors++;
+    }
+    return errors;
+}
+
+int main(int argc, const char *argv[]) {
+    logOpen();
+
+    registerFlag(TYPE_STRING, "-i", "--input", "Binary log (default log.bin)");
+    registerFlag(TYPE_STRING, "-o", "--output", "Append text to file instead of stdout");
+    if (processArgs(argc, argv) != SUCCESS)
+        return 1;
+    const char *input = isFlagSet("-i") ? getFlagValue("-i").string_ : "log.bin";
+
+    FILE *in = fopen(input, "rb");
+    if (!in) {
+        fprintf(stderr, "Can't open %s\n", input);
+        return 1;
+    }
+    FILE *out = stdout;
+    if (isFlagSet("-o") && !(out = fopen(getFlagValue("-o").string_, "a"))) {
+        fprintf(stderr, "Can't open %s\n", getFlagValue("-o").string_);
+        fclose(in);
+        return 1;
+    }
+
+    int errors = decode(in, out);
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+    logClose();
+    return (errors) ? 1 : 0;
+}